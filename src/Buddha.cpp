@@ -1,12 +1,9 @@
 #include <algorithm>
-#include <ctime>
 #include <iomanip>
-#include <iostream>
 #include <chrono>
 #include <cstdint>
-#include <tuple>
 #include <utility>
-#include <queue>
+#include <sstream>
 
 #define cimg_display 0
 #include "CImg.h"
@@ -15,22 +12,53 @@ using namespace cimg_library;
 #include "Buddha.h"
 #include "Utility.hpp"
 
+rgb16 ColoringSchema::color16(uint64_t count, uint64_t max) const {
+    rgb c = color(count, max);
+    return rgb16({ (uint16_t)(c.r * 257), (uint16_t)(c.g * 257), (uint16_t)(c.b * 257) });
+}
+
+static uint16_t component16(double v) {
+    return (uint16_t)clamp(0., 65535., v * 65536.);
+}
+
 rgb ColorGrayscale::color(uint64_t count, uint64_t max) const {
     unsigned char v = count / (double)max * 256.;
     return rgb({ v, v, v });
 }
 
+rgb16 ColorGrayscale::color16(uint64_t count, uint64_t max) const {
+    uint16_t v = component16(count / (double)max);
+    return rgb16({ v, v, v });
+}
+
 rgb ColorSqrt::color(uint64_t count, uint64_t max) const {
     unsigned char v = 256. * std::sqrt(count) / std::sqrt(max);
     return rgb({ v, v, v });
 }
 
+rgb16 ColorSqrt::color16(uint64_t count, uint64_t max) const {
+    uint16_t v = component16(std::sqrt(count) / std::sqrt(max));
+    return rgb16({ v, v, v });
+}
+
 rgb ColorGrayscaleSqrtMixed::color(uint64_t count, uint64_t max) const {
     unsigned char v1 = count / (double)max * 256.;
     unsigned char v2 = 256. * std::sqrt(count) / std::sqrt(max);
     return rgb({ v1, v2, 0 });
 }
 
+rgb16 ColorGrayscaleSqrtMixed::color16(uint64_t count, uint64_t max) const {
+    return rgb16({ component16(count / (double)max),
+                   component16(std::sqrt(count) / std::sqrt(max)), 0 });
+}
+
+double ColorGradient::segment(uint64_t count, uint64_t max, std::size_t & start) const {
+    double position = clamp(0., 1., (double)count / max);
+    double segment_length = 1. / (anchors_.size() - 1);
+    start = std::min((std::size_t)(position / segment_length), anchors_.size() - 1);
+    return clamp(0., 1., (position - start * segment_length) / segment_length);
+}
+
 rgb ColorGradient::color(uint64_t count, uint64_t max) const {
     if (anchors_.size() == 1)
         return anchors_.front();
@@ -58,6 +86,20 @@ rgb ColorGradient::color(uint64_t count, uint64_t max) const {
         };
 }
 
+rgb16 ColorGradient::color16(uint64_t count, uint64_t max) const {
+    std::size_t start_segment = 0;
+    double where = anchors_.size() == 1 ? 0 : segment(count, max, start_segment);
+
+    rgb start = anchors_[start_segment];
+    rgb end = anchors_[std::min(start_segment + 1, anchors_.size() - 1)];
+
+    return
+        { (uint16_t)(257 * (start.r + (end.r - start.r) * where) + .5)
+        , (uint16_t)(257 * (start.g + (end.g - start.g) * where) + .5)
+        , (uint16_t)(257 * (start.b + (end.b - start.b) * where) + .5)
+        };
+}
+
 ColorGradient::ColorGradient(const std::vector<rgb> & anchors) {
     if (anchors.empty())
         throw NoColorProvidedException();
@@ -65,104 +107,543 @@ ColorGradient::ColorGradient(const std::vector<rgb> & anchors) {
     anchors_ = anchors;
 }
 
-std::string Buddha::log_priority_name(LogPriority p) const {
-    switch (p) {
-        case LogPriority::ERROR: return "ERROR";
-        case LogPriority::WARNING: return "WARNING";
-        case LogPriority::NOTICE: return "NOTICE";
-        case LogPriority::INFO: return "INFO";
-        case LogPriority::DEBUG: return "DEBUG";
+/* Tone mapped counts are handed over relative to this maximum */
+static const uint64_t tone_curve_max = 1ull << 32;
+
+ColorToneCurve::ColorToneCurve(const ColoringSchema * schema, Curve curve, double gamma)
+  : schema_(schema), curve_(curve), gamma_(gamma) { }
+
+uint64_t ColorToneCurve::map(uint64_t count, uint64_t max) const {
+    double t = max > 0 ? (double)count / max : 0;
+    switch (curve_) {
+        case Curve::LINEAR: break;
+        case Curve::GAMMA: t = std::pow(t, gamma_); break;
+        case Curve::LOG: t = max > 0 ? std::log1p((double)count) / std::log1p((double)max) : 0; break;
     }
 
-    return "UNKNOWN";
+    return (uint64_t)(clamp(0., 1., t) * tone_curve_max + .5);
+}
+
+rgb ColorToneCurve::color(uint64_t count, uint64_t max) const {
+    return schema_->color(map(count, max), tone_curve_max);
+}
+
+rgb16 ColorToneCurve::color16(uint64_t count, uint64_t max) const {
+    return schema_->color16(map(count, max), tone_curve_max);
 }
 
-Buddha::Buddha(const Params & p, const std::size_t thread_vector_size)
-  : thread_vector_size_(thread_vector_size) {
-    x_size_ = p.width;
-    y_size_ = p.width;
+ColoringSchema * make_tone_curve(const ColoringSchema * schema,
+                                 const std::string & spec) {
+    std::istringstream in(spec);
+    std::string name;
+    in >> name;
+
+    double gamma = 1;
+    if ("linear" == name)
+        return new ColorToneCurve(schema, ColorToneCurve::Curve::LINEAR, gamma);
+    if ("log" == name)
+        return new ColorToneCurve(schema, ColorToneCurve::Curve::LOG, gamma);
+    if ("gamma" == name && in >> gamma && gamma > 0)
+        return new ColorToneCurve(schema, ColorToneCurve::Curve::GAMMA, gamma);
+
+    throw UnknownColoringSchemaException();
+}
+
+ColoringSchema * make_coloring_schema(const std::string & spec) {
+    std::istringstream in(spec);
+    std::string name;
+    in >> name;
+
+    if ("grayscale" == name)
+        return new ColorGrayscale;
+    if ("sqrt" == name)
+        return new ColorSqrt;
+    if ("mixed" == name)
+        return new ColorGrayscaleSqrtMixed;
+    if ("gradient" != name)
+        throw UnknownColoringSchemaException();
+
+    std::vector<rgb> anchors;
+    std::string hex;
+    while (in >> hex) {
+        if (hex.size() != 6
+            || hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+            throw UnknownColoringSchemaException();
+
+        unsigned long v = std::stoul(hex, nullptr, 16);
+        anchors.push_back(rgb({ (unsigned char)(v >> 16),
+                                (unsigned char)(v >> 8),
+                                (unsigned char)v }));
+    }
+
+    return new ColorGradient(anchors);
+}
+
+std::string Buddha::accumulation_name(Accumulation a) {
+    switch (a) {
+        case Accumulation::MUTEX: return "mutex";
+        case Accumulation::STRIPED: return "striped";
+        case Accumulation::ATOMIC: return "atomic";
+        case Accumulation::PRIVATE: return "private";
+    }
+
+    return "unknown";
+}
+
+std::string Buddha::histogram_layout_name(HistogramLayout l) {
+    switch (l) {
+        case HistogramLayout::ROW: return "row";
+        case HistogramLayout::TILED: return "tiled";
+    }
+
+    return "unknown";
+}
+
+std::string Buddha::seed_order_name(SeedOrder o) {
+    switch (o) {
+        case SeedOrder::ROW: return "row";
+        case SeedOrder::MORTON: return "morton";
+        case SeedOrder::HILBERT: return "hilbert";
+    }
+
+    return "unknown";
+}
+
+std::string Buddha::sampler_name(Sampler s) {
+    switch (s) {
+        case Sampler::GRID: return "grid";
+        case Sampler::METROPOLIS: return "metropolis";
+        case Sampler::SOBOL: return "sobol";
+        case Sampler::HALTON: return "halton";
+    }
+
+    return "unknown";
+}
+
+Buddha::Buddha(const Params & p, const std::size_t thread_vector_size, ThreadPool * pool)
+  : logger_(new Logger(p.log_level)), thread_vector_size_(thread_vector_size),
+    pool_(pool) {
+    if (nullptr == pool_) {
+        own_pool_.reset(new ThreadPool);
+        pool_ = own_pool_.get();
+    }
+
+    x_size_ = p.seed_grid > 0 ? p.seed_grid : p.width;
+    y_size_ = x_size_;
     radius_ = p.radius;
-    max_iterations_ = p.max_iterations;
-    min_iterations_ = p.min_iterations;
+
+    /* By default the image shows the whole seed square in square pixels */
+    image_width_ = p.width;
+    double aspect = p.aspect > 0 ? p.aspect
+        : p.height > 0 ? (double)p.width / p.height : 1.;
+    image_height_ = p.height > 0 ? p.height
+        : std::max<uint64_t>(1, (uint64_t)(p.width / aspect + .5));
+    if (0 == image_width_ || 0 == image_height_)
+        throw InvalidImageSizeException();
+    view_center_ = complex_type(p.center_re, p.center_im);
+    view_center_lo_ = complex_type(p.center_re_lo, p.center_im_lo);
+    view_width_ = p.view_width > 0 ? p.view_width : 2 * radius_;
+    view_height_ = view_width_ / aspect;
     subpixel_resolution_ = p.subpixel_resolution;
+    name_ = p.name;
     filename_ = p.name + "." + p.format;
     schema = p.schema != nullptr
         ? p.schema
         : new ColorGrayscale;
+    if (!p.tone_curve.empty())
+        schema = make_tone_curve(schema, p.tone_curve);
+    bit_depth_ = p.bit_depth;
+    save_histogram_ = p.save_histogram;
+    stats_interval_ = p.stats_interval;
+    stats_report_ = p.stats_report;
+    seed_cache_file_ = p.seed_cache;
+    record_seeds_ = false;
     num_threads_ = p.num_threads > 0 
         ? p.num_threads
         : std::thread::hardware_concurrency();
+    counters_.assign(num_threads_, WorkerCounters());
+
+    /* Without channels the whole range goes to one schema coloured channel */
+    channels_ = p.channels;
+    if (channels_.empty())
+        channels_.push_back({ p.min_iterations, p.max_iterations, channel_all_colors });
+
+    if (channels_.size() > max_channels)
+        throw InvalidChannelException();
+
+    /* Orbits are traced once, up to the longest range of any channel */
+    max_iterations_ = 0;
+    min_iterations_ = UINT64_MAX;
+    for (const Channel & channel : channels_) {
+        if (channel.min_iterations > channel.max_iterations)
+            throw MinGreaterThanMaxException();
+        if (channel.color > channel_all_colors
+            || (channel.color == channel_all_colors && channels_.size() > 1))
+            throw InvalidChannelException();
+
+        max_iterations_ = std::max(max_iterations_, channel.max_iterations);
+        min_iterations_ = std::min(min_iterations_, channel.min_iterations);
+    }
 
-    if (max_iterations_ > thread_vector_size)
+    /* Room for a handful of the longest orbit pieces in every channel */
+    orbit_stride_ = std::min(max_iterations_, orbit_chunk_);
+    if (0 == thread_vector_size_)
+        thread_vector_size_ = std::max<std::size_t>(min_flush_points,
+                                                    4 * orbit_stride_ * channels_.size());
+    if (orbit_stride_ * channels_.size() > thread_vector_size_)
         throw MaxIterationsTooBigException();
 
-    if (min_iterations_ > max_iterations_)
-        throw MinGreaterThanMaxException();
+    layout_ = p.histogram_layout;
+    huge_pages_ = p.huge_pages;
+    counter_layout_.width = image_width_;
+    counter_layout_.pixels = image_width_ * image_height_;
+    if (HistogramLayout::TILED == layout_) {
+        const uint64_t side = 1ull << tile_bits_;
+        counter_layout_.tiles_x = (image_width_ + side - 1) / side;
+        counter_layout_.tile_bits = tile_bits_;
+        channel_size_ = counter_layout_.tiles_x
+            * ((image_height_ + side - 1) / side) * side * side;
+    } else {
+        counter_layout_.tiles_x = image_width_;
+        counter_layout_.tile_bits = 0;
+        channel_size_ = image_width_ * image_height_;
+    }
+    counter_layout_.channel_size = channel_size_;
+
+    kernel_ = select_orbit_kernel(p.kernel.empty() ? "auto" : p.kernel, p.precision);
+    kernel_params_.escape_radius_sqr = radius_ * radius_;
+    kernel_params_.max_iterations = max_iterations_;
+    kernel_params_.center_re = view_center_.real();
+    kernel_params_.center_re_lo = view_center_lo_.real();
+    kernel_params_.center_im = view_center_.imag();
+    kernel_params_.center_im_lo = view_center_lo_.imag();
+    kernel_params_.scale_x = image_width_ / view_width_;
+    kernel_params_.offset_x = image_width_ / 2.;
+    kernel_params_.scale_y = image_height_ / view_height_;
+    kernel_params_.offset_y = image_height_ / 2.;
+    kernel_params_.x_size = image_width_;
+    kernel_params_.y_size = image_height_;
+    kernel_params_.tile_shift = counter_layout_.tile_bits;
+    kernel_params_.tiles_x = counter_layout_.tiles_x;
+    two_pass_ = p.two_pass || max_iterations_ > orbit_chunk_;
+
+    /*
+     * render() mirrors the top half of views centred on the real axis, so
+     * the seeds below it are redundant there
+     */
+    symmetric_ = p.symmetric && 0 == view_center_.imag();
+    if (p.symmetric && !symmetric_)
+        log(LogPriority::WARNING, "Symmetric sampling needs a view centred "
+            "on the real axis, disabled");
+
+    /*
+     * An odd height puts a row of pixels on the axis, which the fold would
+     * count once for each pair of mirrored orbits. An odd number of seed
+     * rows puts seeds on the axis, whose mirror images are themselves.
+     */
+    if (symmetric_ && (image_height_ % 2 != 0
+        || (Sampler::GRID == p.sampler && y_size_ * subpixel_resolution_ % 2 != 0))) {
+        log(LogPriority::WARNING, "Symmetric sampling needs an even image height "
+            "and an even number of seed rows, disabled");
+        symmetric_ = false;
+    }
+    kernel_params_.fold_y = symmetric_;
+    kernel_params_.periodicity_tolerance_sqr =
+        p.periodicity_tolerance * p.periodicity_tolerance;
+
+    /* Float orbits fall into cycles of their own that real ones do not have */
+    if (p.periodicity_tolerance > 0 && OrbitPrecision::FLOAT == kernel_.precision) {
+        log(LogPriority::WARNING, "Periodicity detection needs double precision, disabled");
+        kernel_params_.periodicity_tolerance_sqr = 0;
+    }
+    use_interior_map_ = p.interior_map;
+    use_contribution_map_ = p.contribution_map;
+    seed_cells_x_ = (x_size_ + seed_cell_ - 1) / seed_cell_;
+    seed_cells_y_ = (y_size_ + seed_cell_ - 1) / seed_cell_;
+    sample_begin_ = symmetric_ ? y_size_ / 2 * x_size_ : 0;
+    sample_end_ = x_size_ * y_size_;
+
+    sampler_ = p.sampler;
+    random_seed_ = p.random_seed;
+    shard_index_ = p.shard_index;
+    shard_count_ = std::max<uint64_t>(p.shard_count, 1);
+    if (shard_index_ >= shard_count_)
+        throw InvalidShardException();
+
+    order_ = p.seed_order;
+    init_scheduler();
+
+    total_samples_ = shard_samples();
+    if (Sampler::GRID != sampler_ && p.samples > 0)
+        total_samples_ = p.samples / shard_count_
+            + (shard_index_ < p.samples % shard_count_ ? 1 : 0);
+    samples_resumed_ = 0;
+
+    checkpoint_file_ = p.checkpoint;
+    checkpoint_interval_ = p.checkpoint_interval;
+
+    time_limit_ = p.time_limit;
+    sample_limit_ = p.sample_limit;
+    convergence_ = p.convergence;
+    convergence_interval_ = p.convergence_interval;
+
+    preview_file_ = p.name + ".preview." + p.format;
+    preview_interval_ = p.preview_interval;
+    preview_progress_ = p.preview_progress;
+
+    accumulation_ = p.accumulation;
+    numa_ = p.numa;
+    init_numa();
+
+    const uint64_t counters = channels_.size() * channel_size_;
+    if (Accumulation::STRIPED == accumulation_) {
+        stripes_ = std::min<uint64_t>(16 * num_threads_, counters);
+        stripe_size_ = (counters + stripes_ - 1) / stripes_;
+        stripe_locks_ = std::vector<std::mutex>(stripes_ * std::max<std::size_t>(1, replicas_));
+    }
 
-    data_ = std::vector<uint64_t>(x_size_ * y_size_);
+    if (p.memory_limit > 0 && memory_budget().total() > (p.memory_limit << 20)) {
+        log(LogPriority::ERROR, memory_budget_line(memory_budget()) + " exceeds the limit of "
+            + std::to_string(p.memory_limit) + " MiB");
+        throw MemoryLimitException();
+    }
+
+    /* Few enough buckets that the sort pass writes to a handful of pages */
+    sorted_flush_ = p.sorted_flush;
+    bucket_shift_ = 0;
+    while ((counters >> bucket_shift_) >= max_flush_buckets_)
+        ++bucket_shift_;
+
+    /* Merged by pinned threads, so its pages spread over the nodes */
+    data_.reset(counters, huge_pages_, numa_);
+}
+
+Buddha::MemoryBudget Buddha::memory_budget() const {
+    const uint64_t counters = channels_.size() * channel_size_;
+
+    MemoryBudget m;
+    m.histogram = CompactHistogram::bytes(counters);
+    m.private_histograms = (Accumulation::PRIVATE == accumulation_ ? num_threads_ : replicas_)
+        * CompactHistogram::bytes(counters);
+    m.flush_buffers = num_threads_ * thread_vector_size_ * sizeof(uint64_t)
+        * (Accumulation::STRIPED == accumulation_ || sorted_flush_ ? 2 : 1);
+
+    /* Metropolis chains keep the points of their orbit inside the image */
+    m.orbit_buffers = num_threads_ * kernel_.lanes * sizeof(uint64_t)
+        * (orbit_stride_ + (Sampler::METROPOLIS == sampler_ ? max_iterations_ : 0));
+    m.seed_maps = (use_interior_map_ + use_contribution_map_)
+        * seed_cells_x_ * seed_cells_y_;
+    m.snapshot = convergence_ > 0 ? histogram_size() * sizeof(float) : 0;
+    m.image = image_width_ * image_height_ * 3 * (16 == bit_depth_ ? 2 : 1);
+    return m;
+}
+
+std::string Buddha::memory_budget_line(const MemoryBudget & m) const {
+    auto mib = [](std::size_t bytes) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(1) << bytes / 1048576. << " MiB";
+        return oss.str();
+    };
+
+    return "Memory budget " + mib(m.total()) + ": histogram " + mib(m.histogram)
+        + ", private histograms " + mib(m.private_histograms)
+        + ", flush buffers " + mib(m.flush_buffers)
+        + ", orbit buffers " + mib(m.orbit_buffers)
+        + ", seed maps " + mib(m.seed_maps) + ", snapshot " + mib(m.snapshot)
+        + ", image " + mib(m.image);
 }
 
 Buddha::Params Buddha::get_empty_params() {
     Params p;
+    p.height = 0;
+    p.center_re = 0;
+    p.center_im = 0;
+    p.center_re_lo = 0;
+    p.center_im_lo = 0;
+    p.view_width = 0;
+    p.aspect = 0;
+    p.seed_grid = 0;
+    p.contribution_map = false;
+    p.max_iterations = 0;
+    p.min_iterations = 0;
+    p.subpixel_resolution = 1;
     p.num_threads = -1;
+    p.kernel = "auto";
+    p.precision = OrbitPrecision::DOUBLE;
+    p.two_pass = false;
+    p.symmetric = false;
+    p.periodicity_tolerance = 0;
+    p.interior_map = false;
+    p.sampler = Sampler::GRID;
+    p.seed_order = SeedOrder::ROW;
+    p.samples = 0;
+    p.random_seed = 0;
+    p.checkpoint_interval = 600;
+    p.preview_interval = 0;
+    p.preview_progress = 0;
+    p.shard_index = 0;
+    p.shard_count = 1;
+    p.accumulation = Accumulation::MUTEX;
+    p.histogram_layout = HistogramLayout::ROW;
+    p.sorted_flush = false;
+    p.huge_pages = false;
+    p.numa = false;
     p.schema = nullptr;
+    p.bit_depth = 8;
+    p.save_histogram = true;
+    p.stats_interval = 0;
+    p.log_level = LogPriority::DEBUG;
+    p.memory_limit = 0;
+    p.time_limit = 0;
+    p.sample_limit = 0;
+    p.convergence = 0;
+    p.convergence_interval = 10;
     return p;
 }
 
 void Buddha::run() {
-    
-    std::thread logger(&Buddha::log_printer, this);
-    logger.detach();
-
     log(LogPriority::NOTICE, "Rendering " + filename_);
+    log(LogPriority::INFO, "Using " + sampler_name(sampler_) + " sampler"
+        + (Sampler::GRID == sampler_ ? " in " + seed_order_name(order_) + " order" : ""));
+    log(LogPriority::INFO, "Using " + kernel_.name + " orbit kernel in "
+        + orbit_precision_name(kernel_.precision) + " precision with "
+        + std::to_string(kernel_.lanes) + " lanes");
+    if (max_iterations_ > orbit_stride_)
+        log(LogPriority::INFO, "Recording orbits in chunks of "
+            + std::to_string(orbit_stride_) + " iterations in two pass mode");
+    log(LogPriority::INFO, memory_budget_line(memory_budget()));
+    log(LogPriority::INFO, "Histogram in " + histogram_layout_name(layout_) + " layout on "
+        + CompactHistogram::backing_name(data_.backing())
+        + (sorted_flush_ ? ", flushes sorted" : ""));
+
+    progress_ = 0;
+    next_batch_ = 0;
+    std::fill(counters_.begin(), counters_.end(), WorkerCounters());
+    /* Sized up front, the preview thread may read them any time */
+    if (Accumulation::PRIVATE == accumulation_)
+        for (std::size_t i = 0; i < num_threads_; ++i)
+            private_data_.emplace_back(new CompactHistogram(data_.size(), huge_pages_, numa_));
+    for (std::size_t r = 0; r < replicas_; ++r)
+        private_data_.emplace_back(new CompactHistogram(data_.size(), huge_pages_, true));
+    replica_locks_ = std::vector<std::mutex>(replicas_);
+
+    open_seed_cache();
+
+    if (!checkpoint_file_.empty() && histogram_exists(checkpoint_file_))
+        load_checkpoint();
+
+    /* The seeds traced before the checkpoint would be missing from it */
+    if (record_seeds_ && next_batch_ > 0) {
+        log(LogPriority::WARNING, "Seed cache is not recorded by a resumed render");
+        record_seeds_ = false;
+    }
 
-    for (std::size_t i = 0; i < num_threads_; ++i)
-        threads_.emplace_back(&Buddha::worker_proxy, this);
+    if (use_interior_map_)
+        build_interior_map();
 
-    for (auto & t : threads_)
-        t.join();
-    
-    log(LogPriority::NOTICE, "Rendering " + filename_ + " done");
+    if (use_contribution_map_)
+        build_contribution_map();
 
-    auto img = render();
-    img.save(filename_.c_str());
-}
+    active_workers_ = num_threads_;
+    checkpoint_waiting_ = 0;
+    checkpoint_generation_ = 0;
+    checkpoint_pending_ = false;
+    schedule_checkpoint();
 
-void Buddha::log_printer() {
-    std::size_t counter = 0;
-    double all = x_size_ * y_size_ * subpixel_resolution_ * subpixel_resolution_;
+    auto start = std::chrono::steady_clock::now();
+    stop_requested_ = false;
+    snapshot_total_ = 0;
+    deadline_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        start.time_since_epoch()).count() + (int64_t)(time_limit_ * 1e9);
 
-    while (++counter) {
-        if (counter % 10 == 0) {
-            log(LogPriority::NOTICE, 
-                "Done " + std::to_string(100. * progress_ / all) + "%");
-        }
+    monitor_stop_ = false;
+    std::thread preview;
+    if (preview_interval_ > 0 || preview_progress_ > 0)
+        preview = std::thread(&Buddha::preview_loop, this);
+    std::thread progress(&Buddha::progress_loop, this);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        std::lock_guard<std::mutex> _(logitems_lock_);
-        
-        if (logitems_.empty())
-            continue;
-
-        while (!logitems_.empty()) {
-            auto item = logitems_.front();
-            logitems_.pop();
-
-            auto& out = std::get<1>(item) == LogPriority::ERROR ? std::cerr : std::cout;
-            std::time_t ttp = std::chrono::system_clock::to_time_t(std::get<0>(item));
-            struct tm *tm_now = localtime(&ttp);
-            std::string time = std::asctime(tm_now);
-            
-            out << log_priority_name(std::get<1>(item)) << " "
-                << time.substr(0, time.size() - 1) << "     "
-                << std::get<2>(item) << std::endl;
-        }
+    pool_->run(num_threads_, [this](std::size_t i) { worker_proxy(i); });
+
+    {
+        std::lock_guard<std::mutex> _(monitor_lock_);
+        monitor_stop_ = true;
+    }
+    monitor_cv_.notify_all();
+    progress.join();
+    if (preview.joinable())
+        preview.join();
+    snapshot_.clear();
+    snapshot_.shrink_to_fit();
+
+    auto reduce_start = std::chrono::steady_clock::now();
+    if (!private_data_.empty())
+        merge_private_data();
+    auto end = std::chrono::steady_clock::now();
+
+    if (!checkpoint_file_.empty())
+        save_checkpoint();
+
+    /* Seeds of the samples a stop skipped would be missing from the cache */
+    if (record_seeds_ && stop_requested_) {
+        log(LogPriority::WARNING, "Seed cache " + seed_cache_file_
+            + " is not saved, the render stopped early");
+        recorded_seeds_.clear();
+        recorded_seeds_.shrink_to_fit();
+    } else if (record_seeds_) {
+        save_seed_cache_file();
+    }
+
+    double worker_time = num_threads_
+        * std::chrono::duration<double>(reduce_start - start).count();
+    double reduce_time = std::chrono::duration<double>(end - reduce_start).count();
+    WorkerCounters total = sum_counters(counters_.data(), counters_.size());
+    double wait_time = total.merge_wait_ns / 1e9;
+
+    /* Atomic increments never wait on a lock, their contention is not timed */
+    std::ostringstream stats;
+    stats << std::fixed << std::setprecision(3)
+          << "Accumulation " << accumulation_name(accumulation_) << ": waited ";
+    if (Accumulation::ATOMIC == accumulation_)
+        stats << "n/a";
+    else
+        stats << wait_time << " s to merge ("
+              << 100. * wait_time / worker_time << "% of worker time)";
+    stats << ", flushing " << total.flush_ns / 1e9 << " s, reduction " << reduce_time << " s";
+    log(LogPriority::INFO, stats.str());
+    log(LogPriority::INFO, stats_line(total));
+
+    if (!stats_report_.empty())
+        save_stats_report(std::chrono::duration<double>(end - start).count());
+
+    log(LogPriority::NOTICE, "Rendering " + filename_ + " done");
+
+    if (shard_count_ > 1) {
+        std::string part = name_ + ".shard" + std::to_string(shard_index_)
+            + "-of-" + std::to_string(shard_count_) + ".hist";
+        HistogramHeader h = histogram_header();
+        h.next_batch = next_batch_;
+        h.samples_done = progress_;
+        save_histogram(part, h, histogram_reader());
+        log(LogPriority::NOTICE, "Partial histogram saved to " + part);
+        return;
+    }
+
+    if (16 == bit_depth_)
+        render16().save(filename_.c_str());
+    else
+        render().save(filename_.c_str());
+
+    if (save_histogram_) {
+        HistogramHeader h = histogram_header();
+        h.next_batch = next_batch_;
+        h.samples_done = progress_;
+        save_histogram(name_ + ".hist", h, histogram_reader());
+        log(LogPriority::INFO, "Histogram saved to " + name_ + ".hist");
     }
 }
 
 void Buddha::log(LogPriority p, std::string msg) {
-    std::lock_guard<std::mutex> _(logitems_lock_);
-    logitems_.push(std::make_tuple(std::chrono::system_clock::now(), p, msg));
+    logger_->log(p, std::move(msg));
 }
 
 std::pair<uint64_t, uint64_t> Buddha::lin2car(uint64_t pos) const {
@@ -191,58 +672,296 @@ Buddha::complex_type Buddha::lin2complex(uint64_t pos) const {
    return car2complex(pair.first, pair.second);
 }
 
+Buddha::complex_type Buddha::subpixel2complex(uint64_t pos, uint64_t sub_x,
+                                              uint64_t sub_y) const {
+    auto pair = lin2car(pos);
+    const int64_t cols = x_size_ * subpixel_resolution_;
+    const int64_t rows = y_size_ * subpixel_resolution_;
+    const int64_t x = pair.first * subpixel_resolution_ + sub_x;
+    const int64_t y = pair.second * subpixel_resolution_ + sub_y;
+
+    /* Odd numerators around zero, so -c is rounded exactly like c */
+    floating_type re = radius_ * ((floating_type)(2 * x + 1 - cols) / cols);
+    floating_type im = radius_ * ((floating_type)(2 * y + 1 - rows) / rows);
+    return complex_type(re, im);
+}
+
 uint64_t Buddha::complex2lin(Buddha::complex_type c) const {
     auto pair = complex2car(c);
     return car2lin(pair.first, pair.second);
 }
 
-void Buddha::worker_proxy() {
-    while (true) {
-        next_batch_lock_.lock();
-        if (next_batch_ == x_size_ * y_size_) {
-            next_batch_lock_.unlock();
-            break;
+bool Buddha::seed_cell_index(complex_type c, uint64_t & cell) const {
+    double fx = x_size_ * (c.real() / radius_ + 1) / 2.;
+    double fy = y_size_ * (c.imag() / radius_ + 1) / 2.;
+    if (fx < 0 || fx >= x_size_ || fy < 0 || fy >= y_size_)
+        return false;
+
+    cell = (uint64_t)fy / seed_cell_ * seed_cells_x_ + (uint64_t)fx / seed_cell_;
+    return true;
+}
+
+bool Buddha::skip_seed(complex_type c, WorkerState & state) const {
+    if (mandelbrot_hint(c)) {
+        tally(state.counters->hinted);
+        return true;
+    }
+
+    if (known_interior(c) || known_outside_view(c)) {
+        tally(state.counters->culled);
+        return true;
+    }
+
+    return false;
+}
+
+void Buddha::worker_proxy(std::size_t index) {
+    ThreadPin pin(numa_ ? thread_cpus_[index] : -1);
+    WorkerState state;
+    state.index = index;
+    init_worker_state(state);
+
+    if (seed_cache_)
+        cache_worker(state);
+    else if (Sampler::METROPOLIS == sampler_)
+        metropolis_worker(state);
+    else if (Sampler::SOBOL == sampler_ || Sampler::HALTON == sampler_)
+        qmc_worker(state);
+    else
+        grid_worker(state);
+
+    flush_data(state);
+
+    if (record_seeds_) {
+        std::lock_guard<std::mutex> _(recorded_seeds_lock_);
+        recorded_seeds_.insert(recorded_seeds_.end(), state.seeds.begin(), state.seeds.end());
+    }
+
+    leave_checkpoint_barrier();
+}
+
+void Buddha::merge_private_data() {
+    /* Every thread sums one slice of all the private histograms */
+    uint64_t slice = (data_.size() + num_threads_ - 1) / num_threads_;
+
+    pool_->run(num_threads_, [this, slice](std::size_t i) {
+        ThreadPin pin(numa_ ? thread_cpus_[i] : -1);
+        uint64_t from = std::min<uint64_t>(i * slice, data_.size());
+        uint64_t to = std::min<uint64_t>(from + slice, data_.size());
+        for (auto & histogram : private_data_)
+            for (uint64_t j = from; j < to; ++j)
+                data_.add(j, histogram->get(j));
+    });
+
+    private_data_.clear();
+}
+
+HistogramReader Buddha::histogram_reader() const {
+    return [this](uint64_t from, uint64_t n, uint64_t * out) {
+        std::fill(out, out + n, 0);
+        if (HistogramLayout::ROW == layout_) {
+            data_.accumulate(from, n, out);
+            for (auto & histogram : private_data_)
+                histogram->accumulate(from, n, out);
+            return;
         }
 
-        uint64_t from = next_batch_;
-        if (next_batch_ + batch_size_ > x_size_ * y_size_)
-            next_batch_ = x_size_ * y_size_;
-        else
-            next_batch_ += batch_size_;
-        uint64_t to = next_batch_;
+        for (uint64_t k = 0; k < n; ++k) {
+            uint64_t i = counter_layout_.index(from + k);
+            out[k] = data_.get(i);
+            for (auto & histogram : private_data_)
+                out[k] += histogram->get(i);
+        }
+    };
+}
 
-        next_batch_lock_.unlock();
-        worker(from, to);
+/* Runs fn(from, to) on num_threads slices of [0, size) */
+template <typename F>
+static void parallel_slices(uint64_t size, std::size_t num_threads, F fn) {
+    uint64_t slice = (size + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (std::size_t t = 1; t < num_threads; ++t) {
+        uint64_t from = std::min<uint64_t>(t * slice, size);
+        threads.emplace_back(fn, from, std::min<uint64_t>(from + slice, size));
     }
+
+    fn(0, std::min(slice, size));
+    for (auto & t : threads)
+        t.join();
 }
 
-CImg<unsigned char> Buddha::render() {
-    std::lock_guard<std::mutex> _(data_lock_);
-    CImg<unsigned char> img(x_size_, y_size_, 1, 3, 0);
+uint64_t render_lut_index(uint64_t count) {
+    if (count < render_lut_exact)
+        return count;
 
-    uint64_t max = 0;
-    for (uint64_t i = 0; i < data_.size(); ++i) 
-        if (max < data_[i])
-            max = data_[i];
+    /* Like a float: the octave of the count and the bits below its top one */
+    const int top = 63 - __builtin_clzll(count);
+    const int exact_top = 63 - __builtin_clzll(render_lut_exact);
+    const uint64_t mantissa = (count >> (top - render_lut_bits))
+        & ((1ull << render_lut_bits) - 1);
+    return render_lut_exact + ((uint64_t)(top - exact_top) << render_lut_bits) + mantissa;
+}
 
-    for (uint64_t i = 0; i < data_.size() / 2; ++i) {
-        auto car = lin2car(i);
-        rgb c = schema->color(data_[i], max);
-        unsigned char color[] = { c.r, c.g, c.b };
-        img.draw_point(car.first, car.second, color);
-        img.draw_point(car.first, y_size_ - car.second - 1, color);
+uint64_t render_lut_count(uint64_t index) {
+    if (index < render_lut_exact)
+        return index;
+
+    const int exact_top = 63 - __builtin_clzll(render_lut_exact);
+    const uint64_t k = index - render_lut_exact;
+    const int top = exact_top + (int)(k >> render_lut_bits);
+    const uint64_t mantissa = k & ((1ull << render_lut_bits) - 1);
+    return ((1ull << render_lut_bits) | mantissa) << (top - render_lut_bits);
+}
+
+static void schema_color(const ColoringSchema & schema, uint64_t count,
+                         uint64_t max, unsigned char * color) {
+    rgb c = schema.color(count, max);
+    color[0] = c.r;
+    color[1] = c.g;
+    color[2] = c.b;
+}
+
+static void schema_color(const ColoringSchema & schema, uint64_t count,
+                         uint64_t max, unsigned short * color) {
+    rgb16 c = schema.color16(count, max);
+    color[0] = c.r;
+    color[1] = c.g;
+    color[2] = c.b;
+}
+
+/* Counts of a histogram file or of a merged histogram */
+struct PlainCounts {
+    const uint64_t * data;
+    uint64_t operator()(uint64_t i) const { return data[i]; }
+};
+
+/* Counts of a render, possibly still split over private histograms */
+struct CompactCounts {
+    const CompactHistogram & data;
+    const std::vector<std::unique_ptr<CompactHistogram>> & parts;
+    CounterLayout layout;
+
+    uint64_t operator()(uint64_t i) const {
+        i = layout.index(i);
+        uint64_t v = data.get(i);
+        for (auto & part : parts)
+            v += part->get(i);
+        return v;
+    }
+};
+
+/* Counts(i) may grow while it renders, later reads are clamped to the maximum */
+template <typename T, typename Counts>
+static CImg<T> render_histogram_as(const HistogramHeader & header,
+                                   const Counts & counts,
+                                   const ColoringSchema & schema,
+                                   std::size_t num_threads) {
+    const uint64_t width = header.width;
+    const uint64_t height = header.height;
+    const uint64_t size = width * height;
+    const bool mirror = 0 == header.center_im;
+    const uint64_t pixels = mirror ? size / 2 : size;
+    CImg<T> img(width, height, 1, 3, 0);
+
+    if (0 == num_threads)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::max<uint64_t>(1, std::min<uint64_t>(num_threads, size / 65536));
+
+    for (uint32_t channel = 0; channel < header.channels; ++channel) {
+        const uint64_t offset = channel * size;
+        const uint32_t target = header.channel_color[channel];
+
+        uint64_t max = 0;
+        std::mutex max_lock;
+        parallel_slices(size, num_threads, [&](uint64_t from, uint64_t to) {
+            uint64_t slice_max = 0;
+            for (uint64_t i = from; i < to; ++i)
+                slice_max = std::max(slice_max, counts(offset + i));
+
+            std::lock_guard<std::mutex> _(max_lock);
+            max = std::max(max, slice_max);
+        });
+
+        /* One schema call per count, or per entry of the large ones */
+        const bool exact = max < render_lut_size;
+        const uint64_t entries = exact ? max + 1 : render_lut_index(max) + 1;
+        std::vector<T> lut(3 * entries);
+        parallel_slices(entries, num_threads, [&](uint64_t from, uint64_t to) {
+            for (uint64_t k = from; k < to; ++k)
+                schema_color(schema, exact ? k : render_lut_count(k), max, &lut[3 * k]);
+        });
+
+        T * planes[3] = { img.data(0, 0, 0, 0), img.data(0, 0, 0, 1),
+                          img.data(0, 0, 0, 2) };
+        parallel_slices(pixels, num_threads, [&](uint64_t from, uint64_t to) {
+            for (uint64_t i = from; i < to; ++i) {
+                const uint64_t count = std::min(counts(offset + i), max);
+                const T * color = &lut[3 * (exact ? count : render_lut_index(count))];
+                uint64_t mirrored = (height - i / width - 1) * width + i % width;
+
+                for (uint32_t k = 0; k < 3; ++k) {
+                    if (target != channel_all_colors && target != k)
+                        continue;
+                    planes[k][i] = color[k];
+                    if (mirror)
+                        planes[k][mirrored] = color[k];
+                }
+            }
+        });
     }
 
     return img;
 }
 
+CImg<unsigned char> render_histogram(const HistogramHeader & header,
+                                     const uint64_t * data,
+                                     const ColoringSchema & schema,
+                                     std::size_t num_threads) {
+    return render_histogram_as<unsigned char>(header, PlainCounts({ data }), schema,
+                                              num_threads);
+}
+
+CImg<unsigned short> render_histogram16(const HistogramHeader & header,
+                                        const uint64_t * data,
+                                        const ColoringSchema & schema,
+                                        std::size_t num_threads) {
+    return render_histogram_as<unsigned short>(header, PlainCounts({ data }), schema,
+                                               num_threads);
+}
+
+CImg<unsigned char> Buddha::render_counts(const ColoringSchema & colors) {
+    return render_histogram_as<unsigned char>(histogram_header(),
+        CompactCounts({ data_, private_data_, counter_layout_ }), colors, num_threads_);
+}
+
+CImg<unsigned short> Buddha::render_counts16(const ColoringSchema & colors) {
+    return render_histogram_as<unsigned short>(histogram_header(),
+        CompactCounts({ data_, private_data_, counter_layout_ }), colors, num_threads_);
+}
+
+CImg<unsigned char> Buddha::render() {
+    std::lock_guard<std::mutex> _(data_lock_);
+    return render_counts(*schema);
+}
+
+CImg<unsigned short> Buddha::render16() {
+    std::lock_guard<std::mutex> _(data_lock_);
+    return render_counts16(*schema);
+}
+
+CImg<unsigned char> Buddha::render_preview() {
+    /* A single thread, the cores belong to the workers */
+    return render_histogram_as<unsigned char>(histogram_header(),
+        CompactCounts({ data_, private_data_, counter_layout_ }), *schema, 1);
+}
+
 bool Buddha::mandelbrot_hint(complex_type z) const {
     complex_type unit(1, 0), four(4, 0);
     if (std::abs(unit - std::sqrt(unit - four*z)) < 1) 
         return true;
     
-    complex_type iunit(0, 1),  dist = z - iunit;
-    if (dist.real() * dist.real() + dist.imag() * dist.imag() <= 1./8) 
+    complex_type dist = z + unit;
+    if (dist.real() * dist.real() + dist.imag() * dist.imag() <= 1./16)
         return true;
 
     return false;
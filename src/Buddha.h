@@ -4,108 +4,417 @@
 #include <atomic>
 #include <chrono>
 #include <complex>
+#include <condition_variable>
 #include <cstdint>
 #include <exception>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
-#include <tuple>
 #include <utility>
-#include <queue>
+#include <vector>
 
 #define cimg_display 0
 #include "CImg.h"
 using namespace cimg_library;
 
+#include "CompactHistogram.h"
+#include "HistogramFile.h"
+#include "Logger.h"
+#include "Numa.h"
+#include "SeedCache.h"
+#include "ThreadPool.h"
+#include "OrbitKernel.h"
+
 class MaxIterationsTooBigException : public virtual std::exception { };
 
+class MemoryLimitException : public virtual std::exception { };
+
 class MinGreaterThanMaxException : public virtual std::exception { };
 
 class NoColorProvidedException : public virtual std::exception { };
 
+class CheckpointMismatchException : public virtual std::exception { };
+
+class InvalidShardException : public virtual std::exception { };
+
+class InvalidChannelException : public virtual std::exception { };
+
+class InvalidImageSizeException : public virtual std::exception { };
+
 struct rgb {
     unsigned char r;
     unsigned char g;
     unsigned char b;
 };
 
+struct rgb16 {
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+};
+
 class ColoringSchema {
 public:
+    virtual ~ColoringSchema() { }
     virtual rgb color(uint64_t count, uint64_t max) const = 0;
+
+    /* 16 bit output, by default the 8 bit colour scaled up */
+    virtual rgb16 color16(uint64_t count, uint64_t max) const;
 };
 
 class ColorGrayscale : public ColoringSchema {
 public:
     virtual rgb color(uint64_t count, uint64_t max) const;
+    virtual rgb16 color16(uint64_t count, uint64_t max) const;
 };
 
 class ColorGrayscaleSqrtMixed : public ColoringSchema {
 public:
     virtual rgb color(uint64_t count, uint64_t max) const;
+    virtual rgb16 color16(uint64_t count, uint64_t max) const;
 };
 
 class ColorSqrt : public ColoringSchema {
 public:
     virtual rgb color(uint64_t count, uint64_t max) const;
+    virtual rgb16 color16(uint64_t count, uint64_t max) const;
 };
 
 class ColorGradient : public ColoringSchema {
 public:
     virtual rgb color(uint64_t count, uint64_t max) const;
+    virtual rgb16 color16(uint64_t count, uint64_t max) const;
     ColorGradient(const std::vector<rgb> & anchors);
 
 private:
+    double segment(uint64_t count, uint64_t max, std::size_t & start) const;
     std::vector<rgb> anchors_;
 };
 
+/*
+ * Maps count / max through a tone curve before handing it to the schema,
+ * which has to depend on that ratio only, as all of the above do. Log and
+ * gamma < 1 curves spread the dimmest counts over most of the output, so
+ * the render table colours every count below render_lut_exact on its own.
+ */
+class ColorToneCurve : public ColoringSchema {
+public:
+    enum class Curve {
+        LINEAR, GAMMA, LOG
+    };
+
+    virtual rgb color(uint64_t count, uint64_t max) const;
+    virtual rgb16 color16(uint64_t count, uint64_t max) const;
+    ColorToneCurve(const ColoringSchema * schema, Curve curve, double gamma);
+
+private:
+    uint64_t map(uint64_t count, uint64_t max) const;
+    const ColoringSchema * schema_;
+    Curve curve_;
+    double gamma_;
+};
+
+class UnknownColoringSchemaException : public virtual std::exception { };
+
+/*
+ * "grayscale", "sqrt", "mixed" or "gradient" followed by hex colours,
+ * e.g. "gradient 000000 ff8000 ffffff".
+ */
+ColoringSchema * make_coloring_schema(const std::string & spec);
+
+/* "linear", "log" or "gamma" followed by the exponent, e.g. "gamma 0.5" */
+ColoringSchema * make_tone_curve(const ColoringSchema * schema,
+                                 const std::string & spec);
+
+/*
+ * Colours a histogram with num_threads threads, zero uses all cores. Views
+ * centred on the real axis are symmetric, their top half is mirrored to the
+ * bottom one. A single channel is coloured by the schema, otherwise every
+ * channel takes its colour component of the schema.
+ */
+CImg<unsigned char> render_histogram(const HistogramHeader & header,
+                                     const uint64_t * data,
+                                     const ColoringSchema & schema,
+                                     std::size_t num_threads = 0);
+
+/* The same with 16 bits per component */
+CImg<unsigned short> render_histogram16(const HistogramHeader & header,
+                                        const uint64_t * data,
+                                        const ColoringSchema & schema,
+                                        std::size_t num_threads = 0);
+
+/*
+ * Counts are coloured through a table of at most this many entries. Every
+ * count gets its own entry when the largest one fits, otherwise counts of
+ * render_lut_exact and above share entries 2^-render_lut_bits of their size
+ * apart and are coloured as if up to that fraction smaller. That is at most
+ * 0.03 levels of an 8 bit component and 8 levels of a 16 bit one with a
+ * linear curve, and never more than gamma times it through a tone curve.
+ */
+const uint64_t render_lut_size = 1 << 20;
+const uint64_t render_lut_exact = 1 << 19;
+const int render_lut_bits = 13;
+
+/* Table entry of a count above the exact range, and the smallest count of an entry */
+uint64_t render_lut_index(uint64_t count);
+uint64_t render_lut_count(uint64_t index);
+
 class Buddha {
+    /* The microbenchmarks of bench.cpp time the stages on their own */
+    friend class BuddhaBench;
+
 public:
     typedef double floating_type;
     typedef std::complex<floating_type> complex_type; 
 
+    /* How worker threads merge their orbits into the shared histogram */
+    enum class Accumulation {
+        MUTEX, STRIPED, ATOMIC, PRIVATE
+    };
+
+    static std::string accumulation_name(Accumulation a);
+
+    /* Where the seeds c come from */
+    enum class Sampler {
+        GRID, METROPOLIS, SOBOL, HALTON
+    };
+
+    static std::string sampler_name(Sampler s);
+
+    /* Order in which the grid sampler walks the image */
+    enum class SeedOrder {
+        ROW, MORTON, HILBERT
+    };
+
+    static std::string seed_order_name(SeedOrder o);
+
+    /* How the counters of a channel are laid out in memory */
+    enum class HistogramLayout {
+        ROW, TILED
+    };
+
+    static std::string histogram_layout_name(HistogramLayout l);
+
+    /* Escape time range deposited into one histogram channel */
+    struct Channel {
+        uint64_t min_iterations;
+        uint64_t max_iterations;
+        uint32_t color;
+    };
+
     struct Params {
         std::string name;
         std::string format;
         uint64_t width;
+        uint64_t height;
+        floating_type center_re;
+        floating_type center_im;
+        /* Rest of a centre given with more digits than a double holds */
+        floating_type center_re_lo;
+        floating_type center_im_lo;
+        floating_type view_width;
+        double aspect;
+        uint64_t seed_grid;
+        bool contribution_map;
         floating_type radius;
         uint64_t max_iterations;
         uint64_t min_iterations;
         uint64_t subpixel_resolution;
+        std::vector<Channel> channels;
         int num_threads;
+        std::string kernel;
+        OrbitPrecision precision;
+        bool two_pass;
+        bool symmetric;
+        double periodicity_tolerance;
+        bool interior_map;
+        Accumulation accumulation;
+        HistogramLayout histogram_layout;
+        bool sorted_flush;
+        bool huge_pages;
+        bool numa;
+        Sampler sampler;
+        SeedOrder seed_order;
+        uint64_t samples;
+        uint64_t random_seed;
+        std::string checkpoint;
+        double checkpoint_interval;
+        double preview_interval;
+        double preview_progress;
+        uint64_t shard_index;
+        uint64_t shard_count;
         ColoringSchema * schema;
+        std::string tone_curve;
+        int bit_depth;
+        bool save_histogram;
+        double stats_interval;
+        std::string stats_report;
+        LogPriority log_level;
+        /* MiB, 0 for no limit */
+        uint64_t memory_limit;
+        /* Stop conditions, 0 for none */
+        double time_limit;
+        uint64_t sample_limit;
+        double convergence;
+        double convergence_interval;
+        std::string seed_cache;
+        std::string recolor;
     };
 
-    enum class LogPriority {
-        ERROR, WARNING, NOTICE, INFO, DEBUG
-    };
-
-    std::string log_priority_name(LogPriority p) const;
-
-    Buddha(const Params & p, std::size_t thread_vector_size = 10 * 1024 * 1024);
+    /*
+     * Points buffered per thread between flushes, 0 sizes it from max
+     * iterations. Without a pool the render starts one of its own.
+     */
+    Buddha(const Params & p, std::size_t thread_vector_size = 0,
+           ThreadPool * pool = nullptr);
 
     static Params get_empty_params();
 
     void run();
+
+    /* Colours the histogram p.recolor as the image of p, no orbits traced */
+    static void recolor(const Params & p);
+
+    /*
+     * Runs the sections of a config. Sections tracing the same orbits are
+     * rendered once and the others coloured from that histogram, all of
+     * them on one thread pool.
+     */
+    static void run_batch(const std::vector<Params> & ps);
 private:
+    /* Seed grid of x_size_ x y_size_ pixels over [-radius_, radius_]^2 */
     uint64_t x_size_;
     uint64_t y_size_;
     floating_type radius_;
+
+    /* The image shows view_width_ x view_height_ around view_center_ */
+    uint64_t image_width_;
+    uint64_t image_height_;
+    complex_type view_center_;
+    complex_type view_center_lo_;
+    floating_type view_width_;
+    floating_type view_height_;
     uint64_t max_iterations_;
     uint64_t min_iterations_;
     uint64_t subpixel_resolution_;
+    std::string name_;
     std::string filename_;
     ColoringSchema * schema;
+    int bit_depth_;
+
+    /* The raw histogram goes to name_.hist next to the image */
+    bool save_histogram_;
 
-    std::vector<uint64_t> data_;
+    /*
+     * Every channel holds channel_size_ counters. In row layout these are
+     * the image_width_ * image_height_ pixels in row major order, in tiled
+     * layout the image is padded to whole tiles of tile_side_ pixels which
+     * are stored one after the other, so nearby orbit points share pages
+     * and cache lines. Histogram files are always in row major order.
+     */
+    std::vector<Channel> channels_;
+    uint64_t channel_size_;
+    HistogramLayout layout_;
+    CounterLayout counter_layout_;
+    const uint32_t tile_bits_ = 6;
+    bool huge_pages_;
+    /* Counters in a histogram file, channels of image pixels */
+    uint64_t histogram_size() const {
+        return channels_.size() * image_width_ * image_height_;
+    }
+
+    CompactHistogram data_;
     std::mutex data_lock_;
     std::atomic<std::uint_fast64_t> progress_;
 
-    typedef std::tuple<
-                std::chrono::time_point<std::chrono::system_clock>,
-                LogPriority,
-                std::string> logitem_type;
-    std::queue<logitem_type> logitems_;
-    std::mutex logitems_lock_;
-    void log_printer();
+    Accumulation accumulation_;
+    uint64_t stripe_size_;
+    uint64_t stripes_;
+    /* stripes_ locks for every replica, or for data_ */
+    std::vector<std::mutex> stripe_locks_;
+
+    /*
+     * The per thread histograms of the private accumulation, or the per
+     * node replicas of the others. merge_private_data() sums them into
+     * data_ in parallel.
+     */
+    std::vector<std::unique_ptr<CompactHistogram>> private_data_;
+    void merge_private_data();
+
+    /*
+     * With numa_ every worker runs on thread_cpus_[i], spreading the
+     * workers round robin over the NUMA nodes. When they span more than
+     * one node, the workers of node thread_nodes_[i] flush into replica
+     * thread_nodes_[i], whose pages are first touched by those workers.
+     * On a single node data_ takes every flush as before.
+     */
+    bool numa_;
+    std::size_t replicas_;
+    std::vector<int> thread_cpus_;
+    std::vector<std::size_t> thread_nodes_;
+    std::vector<std::mutex> replica_locks_;
+    void init_numa();
+
+    /* Sum of data_ and the private histograms as save_histogram() reads it */
+    HistogramReader histogram_reader() const;
+
+    /*
+     * Hot path counters of one worker thread. Only the owner writes them,
+     * with tally(), so the logger can sum them up while the render runs.
+     */
+    struct WorkerCounters {
+        uint64_t samples;
+        uint64_t hinted;
+        uint64_t culled;
+        uint64_t never_escaped;
+        uint64_t contributed;
+        uint64_t points;
+        uint64_t flushes;
+        uint64_t merge_wait_ns;
+        uint64_t flush_ns;
+        uint64_t batches;
+
+        /* Threads do not share cache lines */
+        uint64_t padding[6];
+    };
+
+    std::vector<WorkerCounters> counters_;
+    double stats_interval_;
+    std::string stats_report_;
+    static void tally(uint64_t & counter, uint64_t n = 1) {
+        __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + n,
+                         __ATOMIC_RELAXED);
+    }
+    WorkerCounters sum_counters(const WorkerCounters * from, std::size_t n) const;
+    std::string stats_line(const WorkerCounters & c) const;
+    void save_stats_report(double elapsed);
+    void progress_loop();
+
+    /*
+     * A render ends early once it ran for time_limit_ seconds, took
+     * sample_limit_ samples, or its normalised histogram moved by less than
+     * convergence_ between two snapshots convergence_interval_ seconds
+     * apart. Workers then stop claiming work and drain what they have, so
+     * the histogram is rendered and checkpointed as after a full run.
+     */
+    double time_limit_;
+    uint64_t sample_limit_;
+    double convergence_;
+    double convergence_interval_;
+    int64_t deadline_ns_;
+    std::atomic<bool> stop_requested_;
+    std::vector<float> snapshot_;
+    double snapshot_total_;
+    bool stop_conditions() const {
+        return time_limit_ > 0 || sample_limit_ > 0 || convergence_ > 0;
+    }
+    bool stop_requested();
+    void request_stop(const std::string & reason);
+    double histogram_change();
+
+    /* Lives as long as this object, safe to use from the worker threads */
+    std::unique_ptr<Logger> logger_;
     void log(LogPriority p, std::string msg);
             
     std::pair<uint64_t, uint64_t> lin2car(uint64_t pos) const;
@@ -115,21 +424,288 @@ private:
     std::pair<uint64_t, uint64_t> complex2car(complex_type c) const;
 
     complex_type lin2complex(uint64_t pos) const;
+    /* Centre of a subpixel, exactly mirrored across both axes */
+    complex_type subpixel2complex(uint64_t pos, uint64_t sub_x, uint64_t sub_y) const;
     uint64_t complex2lin(complex_type c) const;
 
-    const std::size_t thread_vector_size_;
+    std::size_t thread_vector_size_;
+    static const std::size_t min_flush_points = 1 << 20;
+
+    /* Bytes of the large allocations of a render */
+    struct MemoryBudget {
+        std::size_t histogram;
+        std::size_t private_histograms;
+        std::size_t flush_buffers;
+        std::size_t orbit_buffers;
+        std::size_t seed_maps;
+        std::size_t snapshot;
+        std::size_t image;
+
+        std::size_t total() const {
+            return histogram + private_histograms + flush_buffers
+                + orbit_buffers + seed_maps + snapshot + image;
+        }
+    };
+    MemoryBudget memory_budget() const;
+    std::string memory_budget_line(const MemoryBudget & m) const;
     std::size_t num_threads_;
-    std::vector<std::thread> threads_;
-    void worker(uint64_t from, uint64_t to);
-    void flush_data(std::vector<uint64_t> & data, uint64_t & filled);
-    uint64_t next_batch_ = 0;
-    uint64_t batch_size_ = 1000;
-    std::mutex next_batch_lock_;
-    void worker_proxy();
+    ThreadPool * pool_;
+    std::unique_ptr<ThreadPool> own_pool_;
+
+    OrbitKernel kernel_;
+    OrbitKernelParams kernel_params_;
+    bool two_pass_;
+
+    /* Only seeds with Im(c) > 0 are traced, orbits folded to the top half of an even height */
+    bool symmetric_;
+
+    /* Samples waiting to be traced together by kernel_ */
+    struct LaneBatch {
+        std::vector<double> c_re;
+        std::vector<double> c_im;
+        /* Low parts of the seeds, only sized for double-double kernels */
+        std::vector<double> c_re_lo;
+        std::vector<double> c_im_lo;
+        std::vector<uint64_t> escape;
+        std::vector<uint64_t> orbit;
+        std::size_t used;
+
+        /* Orbits recorded in chunks continue from here */
+        std::vector<double> z_re;
+        std::vector<double> z_im;
+        std::vector<double> z_re_lo;
+        std::vector<double> z_im_lo;
+        std::vector<uint64_t> steps;
+    };
+
+    /*
+     * Orbit buffers hold orbit_stride_ points of every lane, the whole
+     * orbit up to orbit_chunk_ iterations. Longer orbits are traced once
+     * for their escape times and then recorded a chunk at a time, which
+     * turns on two pass mode.
+     */
+    const uint64_t orbit_chunk_ = 1 << 14;
+    uint64_t orbit_stride_;
+
+    /* Buffers owned by one worker thread, reused between batches */
+    struct WorkerState {
+        std::size_t index;
+        /* Replica this worker flushes into */
+        std::size_t node;
+        std::vector<uint64_t> local_data;
+        uint64_t filled;
+        LaneBatch batch;
+        LaneBatch replay;
+
+        /* Stripe bucketing for the striped accumulation, or sorted flushes */
+        std::vector<uint64_t> sorted;
+        std::vector<uint64_t> bucket_offsets;
+        std::vector<uint64_t> stripe_offsets;
+        std::vector<uint64_t> stripe_cursors;
+        std::vector<std::size_t> busy_stripes;
+
+        WorkerCounters * counters;
+
+        /* Contributing seeds while recording the seed cache */
+        std::vector<CachedSeed> seeds;
+    };
+
+    bool qualifies(uint64_t escape) const;
+    void count_escape(WorkerState & state, uint64_t escape) const;
+    void deposit_orbit(WorkerState & state, const uint64_t * orbit,
+                       uint64_t length, uint64_t escape);
+    void init_worker_state(WorkerState & state);
+    void init_lane_batch(LaneBatch & batch, bool record);
+    /* Runs the orbit kernel on the seeds of batch, orbit is orbit_stride_ wide */
+    void run_kernel(const OrbitKernelParams & p, LaneBatch & batch, uint64_t * escape,
+                    uint64_t * orbit, OrbitState * state) const;
+    void trace_lanes(WorkerState & state);
+
+    /*
+     * Traces the first used lanes of batch and hands the orbit of every
+     * lane with wanted(lane) to visit(lane, points, n), in pieces of at most
+     * orbit_stride_ points. Escape times are in batch.escape by the time
+     * wanted() is asked, with escapes_known they are taken from there.
+     */
+    typedef std::function<void(std::size_t, const uint64_t *, uint64_t)> OrbitVisitor;
+    void trace_orbits(LaneBatch & batch, std::size_t used, bool escapes_known,
+                      const std::function<bool(std::size_t)> & wanted,
+                      const OrbitVisitor & visit) const;
+
+    /* Replays of two pass mode have their escape times and are counted */
+    void record_lanes(WorkerState & state, LaneBatch & batch, bool replay);
+    void drain_lanes(WorkerState & state);
+    void worker(uint64_t from, uint64_t to, WorkerState & state);
+    void flush_data(WorkerState & state);
+    void flush_striped(WorkerState & state);
+    CompactHistogram & flush_target(const WorkerState & state);
+
+    /*
+     * Sorted flushes first bucket the points by their top bits, a single
+     * counting sort pass into at most max_flush_buckets_ buckets, so the
+     * scatter walks the histogram from front to back
+     */
+    bool sorted_flush_;
+    uint32_t bucket_shift_;
+    const uint64_t max_flush_buckets_ = 256;
+    const uint64_t * sort_local_data(WorkerState & state);
+
+    /*
+     * Seeds which contributed, replayed from seed_cache_ instead of
+     * scanning the grid or recorded while scanning it. A replay traces the
+     * same seeds through a new projection, so at another width it is not
+     * the render a grid of that width would give.
+     */
+    std::string seed_cache_file_;
+    std::unique_ptr<MappedSeedCache> seed_cache_;
+    bool mirror_seeds_;
+    uint64_t cache_begin_;
+    uint64_t cache_end_;
+    bool record_seeds_;
+    std::vector<CachedSeed> recorded_seeds_;
+    std::mutex recorded_seeds_lock_;
+    bool seed_cache_covers(const SeedCacheHeader & h) const;
+    void open_seed_cache();
+    void cache_worker(WorkerState & state);
+    void save_seed_cache_file();
+    Sampler sampler_;
+    uint64_t total_samples_;
+    uint64_t random_seed_;
+    uint64_t samples_resumed_;
+    uint64_t sample_begin_;
+    uint64_t sample_end_;
+
+    /*
+     * The grid is cut into units, runs of batch_size_ pixels in row order or
+     * tile_size_ squares along a space filling curve. Shards take every
+     * shard_count_-th unit and threads claim chunks of the shard's units from
+     * next_batch_, shrinking towards the end, so every unit before
+     * next_batch_ has been handed out.
+     */
+    SeedOrder order_;
+    uint64_t shard_index_;
+    uint64_t shard_count_;
+    uint64_t units_;
+    uint64_t shard_units_;
+    uint64_t tiles_x_;
+    uint64_t tiles_y_;
+    uint64_t curve_side_;
+    std::atomic<uint64_t> next_batch_;
+    const uint64_t batch_size_ = 1000;
+    const uint64_t tile_size_ = 32;
+    const uint64_t max_chunk_ = 8;
+    void init_scheduler();
+    uint64_t shard_samples() const;
+    uint64_t unit_pixels(uint64_t unit) const;
+    bool claim_units(uint64_t & from, uint64_t & to);
+    void sample_unit(uint64_t unit, WorkerState & state);
+    void worker_proxy(std::size_t index);
+    void grid_worker(WorkerState & state);
+    void metropolis_worker(WorkerState & state);
+
+    /*
+     * The low discrepancy samplers walk one open ended sequence. Shards take
+     * every shard_count_-th block of qmc_block_ indices and threads claim
+     * chunks of the shard's stream from next_batch_, which then counts
+     * samples, so a resumed run carries on right after the last one taken.
+     */
+    const uint64_t qmc_block_ = 4096;
+    const uint64_t qmc_chunk_ = 1024;
+    bool claim_samples(uint64_t & from, uint64_t & to);
+    void qmc_worker(WorkerState & state);
     
+    /* Workers meet at a barrier so the histogram is consistent when saved */
+    std::string checkpoint_file_;
+    double checkpoint_interval_;
+    std::atomic<bool> checkpoint_pending_;
+    std::atomic<int64_t> next_checkpoint_;
+    std::mutex checkpoint_lock_;
+    std::condition_variable checkpoint_cv_;
+    std::size_t active_workers_;
+    std::size_t checkpoint_waiting_;
+    uint64_t checkpoint_generation_;
+
+    HistogramHeader histogram_header() const;
+    void schedule_checkpoint();
+    bool checkpoint_due();
+    void checkpoint_barrier(WorkerState & state);
+    void leave_checkpoint_barrier();
+    void release_checkpoint_barrier();
+    void save_checkpoint();
+    void load_checkpoint();
+
     CImg<unsigned char> render();
+    CImg<unsigned short> render16();
+    CImg<unsigned char> render_counts(const ColoringSchema & colors);
+    CImg<unsigned short> render_counts16(const ColoringSchema & colors);
+
+    /* Sections which differ only in how the histogram is coloured and saved */
+    static bool same_orbits(const Params & a, const Params & b);
+    void save_variant(const Params & p);
+
+    /* Schema of p, built in the holders when p does not own one */
+    static const ColoringSchema & output_schema(const Params & p,
+                                                std::unique_ptr<ColoringSchema> & grayscale,
+                                                std::unique_ptr<ColoringSchema> & tone);
+
+    /* data_ plus the private histograms, without taking data_lock_ */
+    CImg<unsigned char> render_preview();
+
+    /*
+     * Preview images written while the workers run. Counters are only ever
+     * written with relaxed atomic stores, so the preview thread can read
+     * them without a lock and the workers never wait for a preview. Every
+     * counter is monotonic, so a snapshot lies between the histograms at its
+     * start and at its end, which may include part of a flush.
+     */
+    std::string preview_file_;
+    double preview_interval_;
+    double preview_progress_;
+
+    /* Stops the preview and progress threads at the end of run() */
+    bool monitor_stop_;
+    std::mutex monitor_lock_;
+    std::condition_variable monitor_cv_;
+    void preview_loop();
+    void save_preview();
 
     bool mandelbrot_hint(complex_type z) const;
+
+    /* Coarse cells of seed_cell_ x seed_cell_ pixels of the seed grid */
+    uint64_t seed_cells_x_;
+    uint64_t seed_cells_y_;
+    const uint64_t seed_cell_ = 16;
+    bool seed_cell_index(complex_type c, uint64_t & cell) const;
+
+    /*
+     * Cells whose sampled boundary never escapes. The escape time level sets
+     * are simply connected, so an unbroken non-escaping boundary would rule
+     * out escaping seeds inside. Only points at the seed spacing are traced,
+     * though, so escaping filaments thinner than that go unnoticed: this is
+     * a heuristic which can drop a few contributing seeds.
+     */
+    std::vector<uint8_t> interior_map_;
+    bool use_interior_map_;
+    void build_interior_map();
+    bool interior_cell(uint64_t cx, uint64_t cy, LaneBatch & batch) const;
+    bool known_interior(complex_type c) const;
+
+    /*
+     * Cells with a sampled escaping seed whose orbit visits the image, and
+     * their neighbours. Seeds elsewhere are assumed to miss the image, which
+     * is an estimate from contribution_samples_^2 seeds per cell: seeds of a
+     * dropped cell may still hit it, so the histogram loses a few percent
+     * of its counts, unevenly. Meant for previews and exploring crops.
+     */
+    std::vector<uint8_t> contribution_map_;
+    bool use_contribution_map_;
+    const uint64_t contribution_samples_ = 8;
+    void build_contribution_map();
+    bool contribution_cell(uint64_t cx, uint64_t cy, LaneBatch & batch) const;
+    bool known_outside_view(complex_type c) const;
+
+    /* Seeds which can be skipped without tracing them, counted in state */
+    bool skip_seed(complex_type c, WorkerState & state) const;
 };
 
 #endif // _BUDDHA_H
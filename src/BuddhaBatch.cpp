@@ -0,0 +1,122 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+
+static bool same_channels(const std::vector<Buddha::Channel> & a,
+                          const std::vector<Buddha::Channel> & b) {
+    if (a.size() != b.size())
+        return false;
+
+    for (std::size_t i = 0; i < a.size(); ++i)
+        if (a[i].min_iterations != b[i].min_iterations
+            || a[i].max_iterations != b[i].max_iterations
+            || a[i].color != b[i].color)
+            return false;
+
+    return true;
+}
+
+bool Buddha::same_orbits(const Params & a, const Params & b) {
+    return a.recolor.empty() && b.recolor.empty()
+        && a.width == b.width && a.height == b.height
+        && a.center_re == b.center_re && a.center_im == b.center_im
+        && a.center_re_lo == b.center_re_lo && a.center_im_lo == b.center_im_lo
+        && a.view_width == b.view_width && a.aspect == b.aspect
+        && a.seed_grid == b.seed_grid
+        && a.contribution_map == b.contribution_map
+        && a.radius == b.radius
+        && a.max_iterations == b.max_iterations
+        && a.min_iterations == b.min_iterations
+        && a.subpixel_resolution == b.subpixel_resolution
+        && same_channels(a.channels, b.channels)
+        && a.num_threads == b.num_threads
+        && a.kernel == b.kernel && a.precision == b.precision
+        && a.two_pass == b.two_pass
+        && a.symmetric == b.symmetric
+        && a.periodicity_tolerance == b.periodicity_tolerance
+        && a.interior_map == b.interior_map
+        && a.accumulation == b.accumulation
+        && a.histogram_layout == b.histogram_layout
+        && a.sorted_flush == b.sorted_flush
+        && a.huge_pages == b.huge_pages && a.numa == b.numa
+        && a.sampler == b.sampler && a.seed_order == b.seed_order
+        && a.samples == b.samples && a.random_seed == b.random_seed
+        && a.time_limit == b.time_limit && a.sample_limit == b.sample_limit
+        && a.convergence == b.convergence
+        && a.convergence_interval == b.convergence_interval
+        && a.checkpoint == b.checkpoint
+        && a.checkpoint_interval == b.checkpoint_interval
+        && a.preview_interval == b.preview_interval
+        && a.preview_progress == b.preview_progress
+        && a.stats_interval == b.stats_interval && a.stats_report == b.stats_report
+        && a.log_level == b.log_level && a.memory_limit == b.memory_limit
+        && a.seed_cache == b.seed_cache
+        && a.shard_index == b.shard_index && a.shard_count == b.shard_count;
+}
+
+void Buddha::run_batch(const std::vector<Params> & ps) {
+    ThreadPool pool;
+
+    /* Groups in the order of their first section */
+    std::vector<std::vector<const Params *>> groups;
+    for (const Params & p : ps) {
+        bool grouped = false;
+        for (auto & group : groups) {
+            /* Sharded renders only save their partial histogram */
+            if (p.shard_count <= 1 && same_orbits(*group.front(), p)) {
+                group.push_back(&p);
+                grouped = true;
+                break;
+            }
+        }
+
+        if (!grouped)
+            groups.push_back({ &p });
+    }
+
+    /*
+     * One group at a time: its histogram is the only large allocation,
+     * the other sections of the group are coloured from it one by one
+     */
+    for (auto & group : groups) {
+        const Params & first = *group.front();
+        if (!first.recolor.empty()) {
+            recolor(first);
+            continue;
+        }
+
+        std::unique_ptr<Buddha> b(new Buddha(first, 0, &pool));
+        b->run();
+
+        for (std::size_t i = 1; i < group.size(); ++i)
+            b->save_variant(*group[i]);
+    }
+}
+
+void Buddha::save_variant(const Params & p) {
+    log(LogPriority::NOTICE, "Rendering " + p.name + "." + p.format
+        + " from the orbits of " + filename_);
+
+    std::unique_ptr<ColoringSchema> grayscale;
+    std::unique_ptr<ColoringSchema> tone;
+    const ColoringSchema & variant = output_schema(p, grayscale, tone);
+    std::string filename = p.name + "." + p.format;
+
+    {
+        std::lock_guard<std::mutex> _(data_lock_);
+        if (16 == p.bit_depth)
+            render_counts16(variant).save(filename.c_str());
+        else
+            render_counts(variant).save(filename.c_str());
+    }
+
+    if (p.save_histogram) {
+        HistogramHeader h = histogram_header();
+        h.next_batch = next_batch_;
+        h.samples_done = progress_;
+        save_histogram(p.name + ".hist", h, histogram_reader());
+        log(LogPriority::INFO, "Histogram saved to " + p.name + ".hist");
+    }
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "HistogramFile.h"
+
+static int64_t checkpoint_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+HistogramHeader Buddha::histogram_header() const {
+    HistogramHeader h = make_histogram_header();
+    h.width = image_width_;
+    h.height = image_height_;
+    h.center_re = view_center_.real();
+    h.center_im = view_center_.imag();
+    h.center_re_lo = view_center_lo_.real();
+    h.center_im_lo = view_center_lo_.imag();
+    h.view_width = view_width_;
+    h.view_height = view_height_;
+    h.seed_grid = x_size_;
+    h.radius = radius_;
+    h.max_iterations = max_iterations_;
+    h.min_iterations = min_iterations_;
+    h.subpixel_resolution = subpixel_resolution_;
+    h.sampler = static_cast<uint32_t>(sampler_);
+    h.symmetric = symmetric_;
+    h.seed_order = static_cast<uint32_t>(order_);
+    h.precision = static_cast<uint32_t>(kernel_.precision);
+    h.channels = channels_.size();
+    for (std::size_t c = 0; c < channels_.size(); ++c) {
+        h.channel_min[c] = channels_[c].min_iterations;
+        h.channel_max[c] = channels_[c].max_iterations;
+        h.channel_color[c] = channels_[c].color;
+    }
+    h.shard_index = shard_index_;
+    h.shard_count = shard_count_;
+    h.count = histogram_size();
+    return h;
+}
+
+void Buddha::schedule_checkpoint() {
+    next_checkpoint_ = checkpoint_clock_ns() + (int64_t)(checkpoint_interval_ * 1e9);
+}
+
+bool Buddha::checkpoint_due() {
+    if (checkpoint_file_.empty() || checkpoint_interval_ <= 0)
+        return false;
+
+    if (checkpoint_pending_)
+        return true;
+
+    if (checkpoint_clock_ns() < next_checkpoint_)
+        return false;
+
+    checkpoint_pending_ = true;
+    return true;
+}
+
+void Buddha::checkpoint_barrier(WorkerState & state) {
+    /* Everything this thread took from the scheduler has to be in data_ */
+    drain_lanes(state);
+    flush_data(state);
+
+    std::unique_lock<std::mutex> lock(checkpoint_lock_);
+    if (!checkpoint_pending_)
+        return;
+
+    uint64_t generation = checkpoint_generation_;
+    if (++checkpoint_waiting_ == active_workers_) {
+        release_checkpoint_barrier();
+        return;
+    }
+
+    checkpoint_cv_.wait(lock, [&]() {
+        return generation != checkpoint_generation_;
+    });
+}
+
+void Buddha::leave_checkpoint_barrier() {
+    std::unique_lock<std::mutex> _(checkpoint_lock_);
+    --active_workers_;
+
+    /* The others may be waiting just for this thread */
+    if (checkpoint_pending_ && active_workers_ > 0
+        && checkpoint_waiting_ == active_workers_)
+        release_checkpoint_barrier();
+}
+
+void Buddha::release_checkpoint_barrier() {
+    /* Called with checkpoint_lock_ held by the last thread to arrive */
+    save_checkpoint();
+
+    checkpoint_waiting_ = 0;
+    ++checkpoint_generation_;
+    checkpoint_pending_ = false;
+    schedule_checkpoint();
+    checkpoint_cv_.notify_all();
+}
+
+void Buddha::save_checkpoint() {
+    HistogramHeader h = histogram_header();
+    h.next_batch = next_batch_;
+    h.samples_done = progress_;
+
+    save_histogram(checkpoint_file_, h, histogram_reader());
+    log(LogPriority::INFO, "Checkpoint saved to " + checkpoint_file_);
+}
+
+void Buddha::load_checkpoint() {
+    MappedHistogram checkpoint(checkpoint_file_);
+    const HistogramHeader & h = checkpoint.header();
+    HistogramHeader expected = histogram_header();
+
+    /* A merged file's next_batch does not say which seeds its shards covered */
+    if (h.merged_shards > 0) {
+        log(LogPriority::ERROR, checkpoint_file_ + " was written by buddha-merge, "
+            "it can be rendered but not resumed");
+        throw CheckpointMismatchException();
+    }
+
+    if (!histograms_compatible(h, expected)
+        || h.shard_index != expected.shard_index
+        || h.shard_count != expected.shard_count
+        || h.seed_order != expected.seed_order)
+        throw CheckpointMismatchException();
+
+    for (uint64_t i = 0; i < h.count; ++i)
+        data_.add(counter_layout_.index(i), checkpoint.data()[i]);
+    next_batch_ = h.next_batch;
+    samples_resumed_ = h.samples_done;
+    progress_ = h.samples_done;
+
+    log(LogPriority::NOTICE, "Resuming from " + checkpoint_file_ + " after "
+        + std::to_string(h.samples_done) + " samples");
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Buddha.h"
+
+bool Buddha::known_outside_view(complex_type c) const {
+    uint64_t cell;
+    return !contribution_map_.empty() && seed_cell_index(c, cell)
+        && !contribution_map_[cell];
+}
+
+bool Buddha::contribution_cell(uint64_t cx, uint64_t cy, LaneBatch & batch) const {
+    const floating_type pixel_width = 2 * radius_ / x_size_;
+    const floating_type pixel_height = 2 * radius_ / y_size_;
+
+    double x0 = cx * seed_cell_;
+    double y0 = cy * seed_cell_;
+    double x1 = std::min<uint64_t>((cx + 1) * seed_cell_, x_size_);
+    double y1 = std::min<uint64_t>((cy + 1) * seed_cell_, y_size_);
+
+    /* Any escaping orbit counts, a cell may hold seeds of every channel */
+    auto visits_view = [&]() {
+        for (std::size_t k = batch.used; k < kernel_.lanes; ++k) {
+            batch.c_re[k] = radius_;
+            batch.c_im[k] = 0;
+        }
+
+        bool inside = false;
+        trace_orbits(batch, batch.used, false,
+            [&](std::size_t k) { return !inside && batch.escape[k] < max_iterations_; },
+            [&](std::size_t, const uint64_t * points, uint64_t n) {
+                for (uint64_t j = 0; j < n && !inside; ++j)
+                    inside = points[j] != orbit_outside;
+            });
+        batch.used = 0;
+        return inside;
+    };
+
+    batch.used = 0;
+    for (uint64_t sy = 0; sy < contribution_samples_; ++sy) {
+        for (uint64_t sx = 0; sx < contribution_samples_; ++sx) {
+            double px = x0 + (x1 - x0) * (sx + .5) / contribution_samples_;
+            double py = y0 + (y1 - y0) * (sy + .5) / contribution_samples_;
+            complex_type c(-radius_ + px * pixel_width, -radius_ + py * pixel_height);
+            if (mandelbrot_hint(c) || known_interior(c))
+                continue;
+
+            batch.c_re[batch.used] = c.real();
+            batch.c_im[batch.used] = c.imag();
+            if (++batch.used == kernel_.lanes && visits_view())
+                return true;
+        }
+    }
+
+    return batch.used > 0 && visits_view();
+}
+
+void Buddha::build_contribution_map() {
+    log(LogPriority::WARNING, "Contribution map is approximate, seeds of the "
+        "cells it drops may still hit the image and are missing from it");
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint8_t> sampled(seed_cells_x_ * seed_cells_y_);
+    std::atomic<uint64_t> next(0);
+
+    pool_->run(num_threads_, [&](std::size_t) {
+        LaneBatch batch;
+        init_lane_batch(batch, true);
+
+        for (uint64_t cell = next++; cell < sampled.size(); cell = next++)
+            sampled[cell] = contribution_cell(cell % seed_cells_x_,
+                                              cell / seed_cells_x_, batch);
+    });
+
+    /* The samples are sparse, so the neighbours of a hit are kept as well */
+    std::vector<uint8_t> map(sampled.size());
+    uint64_t kept = 0;
+    for (uint64_t cy = 0; cy < seed_cells_y_; ++cy) {
+        for (uint64_t cx = 0; cx < seed_cells_x_; ++cx) {
+            bool hit = false;
+            for (uint64_t y = cy > 0 ? cy - 1 : 0; y <= std::min(cy + 1, seed_cells_y_ - 1); ++y)
+                for (uint64_t x = cx > 0 ? cx - 1 : 0; x <= std::min(cx + 1, seed_cells_x_ - 1); ++x)
+                    hit = hit || sampled[y * seed_cells_x_ + x];
+
+            map[cy * seed_cells_x_ + cx] = hit;
+            kept += hit;
+        }
+    }
+
+    contribution_map_ = std::move(map);
+
+    std::ostringstream msg;
+    msg << std::fixed << std::setprecision(3) << "Contribution map: "
+        << kept << " of " << contribution_map_.size() << " cells kept in "
+        << std::chrono::duration<double>(
+               std::chrono::steady_clock::now() - start).count() << " s";
+    log(LogPriority::INFO, msg.str());
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Buddha.h"
+
+bool Buddha::known_interior(complex_type c) const {
+    uint64_t cell;
+    return !interior_map_.empty() && seed_cell_index(c, cell) && interior_map_[cell];
+}
+
+bool Buddha::interior_cell(uint64_t cx, uint64_t cy, LaneBatch & batch) const {
+    const floating_type pixel_width = 2 * radius_ / x_size_;
+    const floating_type pixel_height = 2 * radius_ / y_size_;
+
+    /* Cell boundary in pixels, walked with the spacing of the seed grid */
+    double x0 = cx * seed_cell_;
+    double y0 = cy * seed_cell_;
+    double x1 = std::min<uint64_t>((cx + 1) * seed_cell_, x_size_);
+    double y1 = std::min<uint64_t>((cy + 1) * seed_cell_, y_size_);
+    uint64_t steps_x = (x1 - x0) * subpixel_resolution_;
+    uint64_t steps_y = (y1 - y0) * subpixel_resolution_;
+
+    batch.used = 0;
+    auto escapes = [&]() {
+        for (std::size_t k = batch.used; k < kernel_.lanes; ++k) {
+            batch.c_re[k] = 0;
+            batch.c_im[k] = 0;
+        }
+
+        run_kernel(kernel_params_, batch, batch.escape.data(), nullptr, nullptr);
+        std::size_t used = batch.used;
+        batch.used = 0;
+
+        for (std::size_t k = 0; k < used; ++k)
+            if (batch.escape[k] < max_iterations_)
+                return true;
+        return false;
+    };
+
+    auto add = [&](double px, double py) {
+        complex_type c(-radius_ + px * pixel_width, -radius_ + py * pixel_height);
+        if (mandelbrot_hint(c))
+            return false;
+
+        batch.c_re[batch.used] = c.real();
+        batch.c_im[batch.used] = c.imag();
+        return ++batch.used == kernel_.lanes && escapes();
+    };
+
+    for (uint64_t k = 0; k <= steps_x; ++k) {
+        double px = x0 + (x1 - x0) * k / steps_x;
+        if (add(px, y0) || add(px, y1))
+            return false;
+    }
+
+    for (uint64_t k = 1; k < steps_y; ++k) {
+        double py = y0 + (y1 - y0) * k / steps_y;
+        if (add(x0, py) || add(x1, py))
+            return false;
+    }
+
+    return batch.used == 0 || !escapes();
+}
+
+void Buddha::build_interior_map() {
+    /* Level sets of the escape time are simply connected only for R >= 2 */
+    if (radius_ < 2) {
+        log(LogPriority::WARNING, "Interior map needs radius of at least 2, skipped");
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint8_t> map(seed_cells_x_ * seed_cells_y_);
+
+    std::atomic<uint64_t> next(0);
+    std::atomic<uint64_t> interior(0);
+
+    pool_->run(num_threads_, [&](std::size_t) {
+        LaneBatch batch;
+        init_lane_batch(batch, false);
+
+        for (uint64_t cell = next++; cell < map.size(); cell = next++) {
+            map[cell] = interior_cell(cell % seed_cells_x_,
+                                      cell / seed_cells_x_, batch);
+            interior += map[cell];
+        }
+    });
+
+    interior_map_ = std::move(map);
+
+    std::ostringstream msg;
+    msg << std::fixed << std::setprecision(3) << "Interior map: "
+        << interior << " of " << interior_map_.size() << " cells taken as interior in "
+        << std::chrono::duration<double>(
+               std::chrono::steady_clock::now() - start).count() << " s";
+    log(LogPriority::INFO, msg.str());
+}
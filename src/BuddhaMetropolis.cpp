@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Buddha.h"
+
+/*
+ * Metropolis-Hastings sampler. Every lane of the orbit kernel runs its own
+ * chain whose target distribution is uniform over the contributing seeds,
+ * i.e. seeds escaping inside the range of some channel with at least one
+ * orbit point in the image. All proposals are symmetric, so a proposal
+ * is accepted exactly when it contributes and every step deposits the orbit
+ * of the current seed with weight one. The histogram then matches the one
+ * of the grid sampler up to a constant factor, while almost no time is
+ * spent on seeds which never show up in the image.
+ */
+
+namespace {
+
+/* Probability of replacing the seed by a fresh uniform one */
+const double large_mutation_probability = 0.2;
+
+struct Chain {
+    bool valid;
+    Buddha::complex_type c;
+    /* What double-double kernels add to c */
+    Buddha::complex_type c_lo;
+    uint64_t escape;
+    std::vector<uint64_t> orbit;
+};
+
+/*
+ * hi + lo += d with the rounding error of the sum kept in lo, so steps
+ * below the last bit of the seed still move double-double chains
+ */
+void add_step(double & hi, double & lo, double d) {
+    double s = hi + d;
+    double bb = s - hi;
+    double e = (hi - (s - bb)) + (d - bb) + lo;
+    hi = s + e;
+    lo = e - (hi - s);
+}
+
+}
+
+void Buddha::metropolis_worker(WorkerState & state) {
+    /* Every proposal needs its orbit, two pass mode has it in replay only */
+    LaneBatch & batch = two_pass_ ? state.replay : state.batch;
+    const std::size_t lanes = kernel_.lanes;
+
+    uint64_t left = total_samples_ - std::min(samples_resumed_, total_samples_);
+    uint64_t remaining = left / num_threads_
+        + (state.index < left % num_threads_ ? 1 : 0);
+
+    /* Any seed outside of this square escapes right away */
+    floating_type domain = std::max<floating_type>(radius_, 2);
+    floating_type step_size = view_width_ / image_width_;
+
+    /* Resumed chains must not replay the random numbers of the first run */
+    std::mt19937_64 rng(((random_seed_ * shard_count_ + shard_index_)
+                         * num_threads_ + state.index)
+                        ^ (samples_resumed_ * 0x9e3779b97f4a7c15ull));
+    std::uniform_real_distribution<floating_type> uniform(-domain, domain);
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::normal_distribution<floating_type> step(0, step_size);
+
+    std::vector<Chain> chains(lanes);
+    std::vector<complex_type> proposals(lanes), proposals_lo(lanes);
+    const bool low_parts = !batch.c_re_lo.empty();
+    std::vector<uint8_t> traced(lanes);
+    std::vector<std::vector<uint64_t>> inside(lanes);
+    for (auto & chain : chains)
+        chain.valid = false;
+
+    std::size_t progress_local = 0;
+
+    while (remaining > 0 && !stop_requested()) {
+        if (checkpoint_due()) {
+            progress_ += progress_local;
+            progress_local = 0;
+            checkpoint_barrier(state);
+        }
+
+        std::size_t used = std::min<uint64_t>(lanes, remaining);
+
+        for (std::size_t k = 0; k < lanes; ++k) {
+            batch.c_re[k] = radius_;
+            batch.c_im[k] = 0;
+            if (low_parts) {
+                batch.c_re_lo[k] = 0;
+                batch.c_im_lo[k] = 0;
+            }
+            traced[k] = false;
+            if (k >= used)
+                continue;
+
+            const Chain & chain = chains[k];
+            complex_type c, c_lo;
+            if (!chain.valid || chance(rng) < large_mutation_probability) {
+                c = complex_type(uniform(rng), uniform(rng));
+            } else if (low_parts) {
+                double re = chain.c.real(), im = chain.c.imag();
+                double re_lo = chain.c_lo.real(), im_lo = chain.c_lo.imag();
+                add_step(re, re_lo, step(rng));
+                add_step(im, im_lo, step(rng));
+                c = complex_type(re, im);
+                c_lo = complex_type(re_lo, im_lo);
+            } else {
+                c = chain.c + complex_type(step(rng), step(rng));
+            }
+
+            if (symmetric_ && c.imag() < 0) {
+                c = std::conj(c);
+                c_lo = std::conj(c_lo);
+            }
+
+            proposals[k] = c;
+            proposals_lo[k] = c_lo;
+            tally(state.counters->samples);
+            if (skip_seed(c, state))
+                continue;
+
+            traced[k] = true;
+            batch.c_re[k] = c.real();
+            batch.c_im[k] = c.imag();
+            if (low_parts) {
+                batch.c_re_lo[k] = c_lo.real();
+                batch.c_im_lo[k] = c_lo.imag();
+            }
+        }
+
+        /* Proposals contribute with any orbit point inside of the image */
+        for (auto & points : inside)
+            points.clear();
+        trace_orbits(batch, used, false,
+            [&](std::size_t k) { return traced[k] && qualifies(batch.escape[k]); },
+            [&](std::size_t k, const uint64_t * points, uint64_t n) {
+                for (uint64_t j = 0; j < n; ++j)
+                    if (points[j] != orbit_outside)
+                        inside[k].push_back(points[j]);
+            });
+        tally(state.counters->batches);
+
+        for (std::size_t k = 0; k < used; ++k) {
+            Chain & chain = chains[k];
+            if (traced[k])
+                count_escape(state, batch.escape[k]);
+
+            if (!inside[k].empty()) {
+                chain.valid = true;
+                chain.c = proposals[k];
+                chain.c_lo = proposals_lo[k];
+                chain.escape = batch.escape[k];
+                chain.orbit.swap(inside[k]);
+            }
+
+            if (!chain.valid)
+                continue;
+
+            deposit_orbit(state, chain.orbit.data(), chain.orbit.size(),
+                          chain.escape);
+        }
+
+        remaining -= used;
+        progress_local += used;
+        if (progress_local > 10000) {
+            progress_ += progress_local;
+            progress_local = 0;
+        }
+    }
+
+    progress_ += progress_local;
+}
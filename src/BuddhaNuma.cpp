@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "Numa.h"
+
+void Buddha::init_numa() {
+    replicas_ = 0;
+    thread_cpus_.assign(num_threads_, -1);
+    thread_nodes_.assign(num_threads_, 0);
+    if (!numa_)
+        return;
+
+    NumaTopology topology = numa_topology();
+    if (topology.node_cpus.empty()) {
+        log(LogPriority::WARNING, "No CPUs found to pin the workers to, NUMA placement disabled");
+        numa_ = false;
+        return;
+    }
+
+    /* One CPU of every node in turn, so a few threads already use all nodes */
+    std::vector<std::pair<int, std::size_t>> cpus;
+    for (std::size_t k = 0; ; ++k) {
+        std::size_t added = 0;
+        for (std::size_t n = 0; n < topology.node_cpus.size(); ++n) {
+            if (k < topology.node_cpus[n].size()) {
+                cpus.push_back({ topology.node_cpus[n][k], n });
+                ++added;
+            }
+        }
+        if (0 == added)
+            break;
+    }
+
+    std::vector<std::size_t> replica_of(topology.node_cpus.size(), SIZE_MAX);
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < num_threads_; ++i) {
+        /* More workers than CPUs share them in the same order */
+        const auto & cpu = cpus[i % cpus.size()];
+        thread_cpus_[i] = cpu.first;
+        std::size_t & replica = replica_of[cpu.second];
+        if (SIZE_MAX == replica)
+            replica = used++;
+        thread_nodes_[i] = replica;
+    }
+
+    /* Private histograms are per thread and local already */
+    if (used > 1 && Accumulation::PRIVATE != accumulation_)
+        replicas_ = used;
+    else
+        std::fill(thread_nodes_.begin(), thread_nodes_.end(), 0);
+
+    log(LogPriority::INFO, "Pinning " + std::to_string(num_threads_) + " workers to "
+        + std::to_string(std::min<std::size_t>(num_threads_, cpus.size())) + " CPUs on "
+        + std::to_string(used) + " of " + std::to_string(topology.node_cpus.size())
+        + " NUMA nodes, " + (replicas_ > 0 ? std::to_string(replicas_) + " histogram replicas"
+                                           : std::string("no histogram replicas")));
+}
@@ -0,0 +1,58 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "Buddha.h"
+
+void Buddha::preview_loop() {
+    typedef std::chrono::steady_clock clock;
+    auto next_time = clock::now() + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(preview_interval_));
+    double next_progress = preview_progress_;
+    double all = total_samples_;
+
+    std::unique_lock<std::mutex> lock(monitor_lock_);
+    while (!monitor_cv_.wait_for(lock, std::chrono::milliseconds(100),
+                                 [this]() { return monitor_stop_; })) {
+        bool due = false;
+
+        if (preview_interval_ > 0 && clock::now() >= next_time) {
+            due = true;
+            next_time = clock::now() + std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(preview_interval_));
+        }
+
+        if (preview_progress_ > 0 && all > 0 && 100. * progress_ / all >= next_progress) {
+            due = true;
+            while (next_progress <= 100. * progress_ / all)
+                next_progress += preview_progress_;
+        }
+
+        if (due) {
+            lock.unlock();
+            save_preview();
+            lock.lock();
+        }
+    }
+}
+
+void Buddha::save_preview() {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t samples = progress_;
+
+    /* Viewers never see a half written image */
+    std::string tmp = name_ + ".preview.tmp"
+        + preview_file_.substr(preview_file_.rfind('.'));
+    render_preview().save(tmp.c_str());
+    std::rename(tmp.c_str(), preview_file_.c_str());
+
+    std::ostringstream msg;
+    msg << std::fixed << std::setprecision(3) << "Preview saved to "
+        << preview_file_ << " after " << samples << " samples in "
+        << std::chrono::duration<double>(
+               std::chrono::steady_clock::now() - start).count() << " s";
+    log(LogPriority::INFO, msg.str());
+}
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include "Buddha.h"
+
+/*
+ * Low discrepancy samplers. Seed i of the sequence is point i of the two
+ * dimensional Sobol or Halton sequence scaled onto the seed square
+ * [-radius, radius]², the upper half of it for symmetric renders. Any
+ * prefix of either sequence covers the square evenly, so a render can be
+ * stopped after any number of samples and continued later with more,
+ * without the aliasing of a regular grid. The sequence is randomised once
+ * per random seed, with a digital shift for Sobol and a rotation for
+ * Halton, which keeps its spacing.
+ */
+
+namespace {
+
+const int qmc_bits = 64;
+
+struct SobolDirections {
+    uint64_t v[2][qmc_bits];
+
+    SobolDirections() {
+        /* Van der Corput for the first dimension, x + 1 for the second */
+        for (int j = 0; j < qmc_bits; ++j)
+            v[0][j] = 1ull << (qmc_bits - 1 - j);
+
+        v[1][0] = 1ull << (qmc_bits - 1);
+        for (int j = 1; j < qmc_bits; ++j)
+            v[1][j] = v[1][j - 1] ^ (v[1][j - 1] >> 1);
+    }
+};
+
+const SobolDirections sobol_directions;
+
+/* 53 leading bits as a double in [0, 1) */
+double unit_interval(uint64_t bits) {
+    return (bits >> 11) * (1. / (1ull << 53));
+}
+
+void sobol_point(uint64_t i, uint64_t shift_x, uint64_t shift_y,
+                 double & x, double & y) {
+    uint64_t bx = shift_x;
+    uint64_t by = shift_y;
+    for (int j = 0; i != 0; ++j, i >>= 1) {
+        if (i & 1) {
+            bx ^= sobol_directions.v[0][j];
+            by ^= sobol_directions.v[1][j];
+        }
+    }
+
+    x = unit_interval(bx);
+    y = unit_interval(by);
+}
+
+double radical_inverse(uint64_t i, uint64_t base) {
+    double inverse = 1. / base;
+    double digit = inverse;
+    double r = 0;
+    while (i != 0) {
+        r += (i % base) * digit;
+        i /= base;
+        digit *= inverse;
+    }
+
+    return r;
+}
+
+void halton_point(uint64_t i, double shift_x, double shift_y, double & x, double & y) {
+    x = radical_inverse(i, 2) + shift_x;
+    y = radical_inverse(i, 3) + shift_y;
+    x -= std::floor(x);
+    y -= std::floor(y);
+}
+
+}
+
+bool Buddha::claim_samples(uint64_t & from, uint64_t & to) {
+    uint64_t next = next_batch_.load(std::memory_order_relaxed);
+
+    while (next < total_samples_) {
+        uint64_t chunk = std::min(qmc_chunk_, total_samples_ - next);
+        if (next_batch_.compare_exchange_weak(next, next + chunk,
+                                              std::memory_order_relaxed)) {
+            from = next;
+            to = next + chunk;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Buddha::qmc_worker(WorkerState & state) {
+    LaneBatch & batch = state.batch;
+
+    /* Same for every thread and shard, they all share one sequence */
+    std::mt19937_64 rng(random_seed_);
+    uint64_t shift_x = rng();
+    uint64_t shift_y = rng();
+
+    floating_type height = symmetric_ ? radius_ : 2 * radius_;
+    floating_type bottom = symmetric_ ? 0 : -radius_;
+
+    std::size_t progress_local = 0;
+    uint64_t from, to;
+
+    while (true) {
+        if (checkpoint_due())
+            checkpoint_barrier(state);
+
+        if (stop_requested() || !claim_samples(from, to))
+            break;
+        tally(state.counters->batches);
+
+        for (uint64_t s = from; s < to; ++s) {
+            uint64_t block = s / qmc_block_ * shard_count_ + shard_index_;
+            uint64_t i = block * qmc_block_ + s % qmc_block_;
+
+            double x, y;
+            if (Sampler::SOBOL == sampler_)
+                sobol_point(i, shift_x, shift_y, x, y);
+            else
+                halton_point(i, unit_interval(shift_x), unit_interval(shift_y), x, y);
+
+            ++progress_local;
+            tally(state.counters->samples);
+
+            complex_type c(2 * radius_ * x - radius_, bottom + height * y);
+            if (symmetric_ && c.imag() <= 0)
+                continue;
+
+            if (skip_seed(c, state))
+                continue;
+
+            batch.c_re[batch.used] = c.real();
+            batch.c_im[batch.used] = c.imag();
+            if (++batch.used == kernel_.lanes)
+                trace_lanes(state);
+        }
+
+        progress_ += progress_local;
+        progress_local = 0;
+    }
+
+    drain_lanes(state);
+}
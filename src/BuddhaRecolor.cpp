@@ -0,0 +1,40 @@
+#include <memory>
+#include <string>
+
+#include "Buddha.h"
+#include "HistogramFile.h"
+
+const ColoringSchema & Buddha::output_schema(const Params & p,
+                                             std::unique_ptr<ColoringSchema> & grayscale,
+                                             std::unique_ptr<ColoringSchema> & tone) {
+    const ColoringSchema * schema = p.schema;
+    if (nullptr == schema) {
+        grayscale.reset(new ColorGrayscale);
+        schema = grayscale.get();
+    }
+
+    if (!p.tone_curve.empty()) {
+        tone.reset(make_tone_curve(schema, p.tone_curve));
+        schema = tone.get();
+    }
+
+    return *schema;
+}
+
+void Buddha::recolor(const Params & p) {
+    MappedHistogram histogram(p.recolor);
+
+    std::unique_ptr<ColoringSchema> grayscale;
+    std::unique_ptr<ColoringSchema> tone;
+    const ColoringSchema * schema = &output_schema(p, grayscale, tone);
+
+    std::string filename = p.name + "." + p.format;
+    std::size_t num_threads = p.num_threads > 0 ? p.num_threads : 0;
+
+    if (16 == p.bit_depth)
+        render_histogram16(histogram.header(), histogram.data(), *schema, num_threads)
+            .save(filename.c_str());
+    else
+        render_histogram(histogram.header(), histogram.data(), *schema, num_threads)
+            .save(filename.c_str());
+}
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "Buddha.h"
+
+/* De-interleaves the even bits of v */
+static uint64_t compact_bits(uint64_t v) {
+    v &= 0x5555555555555555ull;
+    v = (v | (v >> 1)) & 0x3333333333333333ull;
+    v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+    v = (v | (v >> 16)) & 0x00000000ffffffffull;
+    return v;
+}
+
+static void morton2car(uint64_t d, uint64_t & x, uint64_t & y) {
+    x = compact_bits(d);
+    y = compact_bits(d >> 1);
+}
+
+static void hilbert2car(uint64_t side, uint64_t d, uint64_t & x, uint64_t & y) {
+    x = y = 0;
+    for (uint64_t s = 1; s < side; s *= 2) {
+        uint64_t rx = 1 & (d / 2);
+        uint64_t ry = 1 & (d ^ rx);
+        if (0 == ry) {
+            if (1 == rx) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+void Buddha::init_scheduler() {
+    tiles_x_ = (x_size_ + tile_size_ - 1) / tile_size_;
+    tiles_y_ = (y_size_ + tile_size_ - 1) / tile_size_;
+    curve_side_ = 1;
+    while (curve_side_ < std::max(tiles_x_, tiles_y_))
+        curve_side_ *= 2;
+
+    if (SeedOrder::ROW == order_)
+        units_ = (sample_end_ - sample_begin_ + batch_size_ - 1) / batch_size_;
+    else
+        units_ = curve_side_ * curve_side_;
+
+    shard_units_ = (units_ + shard_count_ - 1 - shard_index_) / shard_count_;
+}
+
+uint64_t Buddha::unit_pixels(uint64_t unit) const {
+    if (SeedOrder::ROW == order_) {
+        uint64_t from = sample_begin_ + unit * batch_size_;
+        return std::min(batch_size_, sample_end_ - from);
+    }
+
+    uint64_t tx, ty;
+    if (SeedOrder::MORTON == order_)
+        morton2car(unit, tx, ty);
+    else
+        hilbert2car(curve_side_, unit, tx, ty);
+
+    if (tx >= tiles_x_ || ty >= tiles_y_)
+        return 0;
+
+    uint64_t width = std::min(tile_size_, x_size_ - tx * tile_size_);
+    uint64_t pixels = 0;
+    for (uint64_t y = ty * tile_size_; y < std::min((ty + 1) * tile_size_, y_size_); ++y)
+        if (y * x_size_ >= sample_begin_)
+            pixels += width;
+
+    return pixels;
+}
+
+uint64_t Buddha::shard_samples() const {
+    uint64_t pixels = 0;
+    for (uint64_t unit = shard_index_; unit < units_; unit += shard_count_)
+        pixels += unit_pixels(unit);
+
+    return pixels * subpixel_resolution_ * subpixel_resolution_;
+}
+
+bool Buddha::claim_units(uint64_t & from, uint64_t & to) {
+    uint64_t next = next_batch_.load(std::memory_order_relaxed);
+
+    while (next < shard_units_) {
+        /*
+         * Chunks shrink as the work runs out so the threads finish together,
+         * and stay single units when a stop condition may end the run early
+         */
+        uint64_t left = shard_units_ - next;
+        uint64_t chunk = std::max<uint64_t>(1,
+            std::min(stop_conditions() ? 1 : max_chunk_, left / (4 * num_threads_)));
+
+        if (next_batch_.compare_exchange_weak(next, next + chunk,
+                                              std::memory_order_relaxed)) {
+            from = next;
+            to = next + chunk;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Buddha::sample_unit(uint64_t unit, WorkerState & state) {
+    if (SeedOrder::ROW == order_) {
+        uint64_t from = sample_begin_ + unit * batch_size_;
+        worker(from, std::min(from + batch_size_, sample_end_), state);
+        return;
+    }
+
+    uint64_t tx, ty;
+    if (SeedOrder::MORTON == order_)
+        morton2car(unit, tx, ty);
+    else
+        hilbert2car(curve_side_, unit, tx, ty);
+
+    if (tx >= tiles_x_ || ty >= tiles_y_)
+        return;
+
+    uint64_t x_from = tx * tile_size_;
+    uint64_t x_to = std::min(x_from + tile_size_, x_size_);
+    for (uint64_t y = ty * tile_size_; y < std::min((ty + 1) * tile_size_, y_size_); ++y) {
+        uint64_t from = std::max(y * x_size_ + x_from, sample_begin_);
+        uint64_t to = y * x_size_ + x_to;
+        if (from < to)
+            worker(from, to, state);
+    }
+}
+
+void Buddha::grid_worker(WorkerState & state) {
+    uint64_t from, to;
+
+    while (true) {
+        if (checkpoint_due())
+            checkpoint_barrier(state);
+
+        if (stop_requested() || !claim_units(from, to))
+            break;
+        tally(state.counters->batches);
+
+        for (uint64_t u = from; u < to; ++u)
+            sample_unit(u * shard_count_ + shard_index_, state);
+    }
+
+    drain_lanes(state);
+}
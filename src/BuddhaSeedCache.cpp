@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+
+bool Buddha::seed_cache_covers(const SeedCacheHeader & h) const {
+    if (h.radius != radius_ || h.precision != (uint32_t)kernel_.precision)
+        return false;
+
+    /* Every seed contributing now must have contributed back then */
+    for (const Channel & channel : channels_) {
+        bool covered = false;
+        for (uint32_t r = 0; r < h.ranges; ++r)
+            covered = covered || (channel.min_iterations >= h.range_min[r]
+                                  && channel.max_iterations <= h.range_max[r]);
+        if (!covered)
+            return false;
+    }
+
+    return true;
+}
+
+void Buddha::open_seed_cache() {
+    seed_cache_.reset();
+    record_seeds_ = false;
+    if (seed_cache_file_.empty())
+        return;
+
+    if (histogram_exists(seed_cache_file_)) {
+        std::unique_ptr<MappedSeedCache> cache;
+        try {
+            cache.reset(new MappedSeedCache(seed_cache_file_));
+        } catch (InvalidSeedCacheException &) {
+            log(LogPriority::WARNING, "Seed cache " + seed_cache_file_
+                + " is damaged or of an older version, rebuilding it");
+        }
+
+        if (cache && seed_cache_covers(cache->header())) {
+            seed_cache_ = std::move(cache);
+        } else if (cache) {
+            log(LogPriority::WARNING, "Seed cache " + seed_cache_file_
+                + " was recorded with other radius, precision or iterations, rebuilding it");
+        }
+    }
+
+    /* The contribution map drops seeds which only miss this view */
+    if (!seed_cache_) {
+        if (Sampler::METROPOLIS == sampler_ || shard_count_ > 1 || use_contribution_map_)
+            log(LogPriority::WARNING, "Seed cache is only recorded by unsharded grid "
+                "or low discrepancy renders without contribution map");
+        else
+            record_seeds_ = true;
+        return;
+    }
+
+    /* Mirror images of a symmetric cache fill in the lower half */
+    const SeedCacheHeader & h = seed_cache_->header();
+    mirror_seeds_ = h.symmetric && !symmetric_;
+    cache_begin_ = h.count * shard_index_ / shard_count_;
+    cache_end_ = h.count * (shard_index_ + 1) / shard_count_;
+    next_batch_ = 0;
+    total_samples_ = (cache_end_ - cache_begin_) * (mirror_seeds_ ? 2 : 1);
+
+    /* The scans which would pick these seeds have nothing left to do */
+    use_interior_map_ = false;
+    use_contribution_map_ = false;
+    if (!checkpoint_file_.empty()) {
+        log(LogPriority::WARNING, "Checkpoints are not taken while replaying a seed cache");
+        checkpoint_file_.clear();
+    }
+
+    log(LogPriority::INFO, "Replaying " + std::to_string(cache_end_ - cache_begin_)
+        + " cached seeds from " + seed_cache_file_);
+}
+
+void Buddha::cache_worker(WorkerState & state) {
+    /* Every cached seed contributes, so each one needs its orbit right away */
+    LaneBatch & batch = two_pass_ ? state.replay : state.batch;
+    const CachedSeed * seeds = seed_cache_->seeds();
+    const uint64_t chunk = 4096;
+    std::size_t progress_local = 0;
+
+    auto add = [&](complex_type c) {
+        ++progress_local;
+        tally(state.counters->samples);
+
+        if (symmetric_ && c.imag() <= 0)
+            return;
+        if (skip_seed(c, state))
+            return;
+
+        batch.c_re[batch.used] = c.real();
+        batch.c_im[batch.used] = c.imag();
+        if (++batch.used == kernel_.lanes)
+            record_lanes(state, batch, false);
+    };
+
+    while (!stop_requested()) {
+        uint64_t from = cache_begin_ + next_batch_.fetch_add(chunk);
+        if (from >= cache_end_)
+            break;
+        tally(state.counters->batches);
+
+        for (uint64_t i = from; i < std::min(from + chunk, cache_end_); ++i) {
+            complex_type c(seeds[i].re, seeds[i].im);
+            add(c);
+            /* A seed on the axis is its own mirror image */
+            if (mirror_seeds_ && c.imag() != 0)
+                add(std::conj(c));
+        }
+
+        progress_ += progress_local;
+        progress_local = 0;
+    }
+
+    if (batch.used > 0)
+        record_lanes(state, batch, false);
+}
+
+void Buddha::save_seed_cache_file() {
+    SeedCacheHeader h = make_seed_cache_header();
+    h.radius = radius_;
+    h.precision = (uint32_t)kernel_.precision;
+    h.symmetric = symmetric_;
+    h.ranges = channels_.size();
+    for (std::size_t c = 0; c < channels_.size(); ++c) {
+        h.range_min[c] = channels_[c].min_iterations;
+        h.range_max[c] = channels_[c].max_iterations;
+    }
+
+    save_seed_cache(seed_cache_file_, h, recorded_seeds_);
+    log(LogPriority::INFO, "Seed cache of " + std::to_string(recorded_seeds_.size())
+        + " seeds saved to " + seed_cache_file_);
+
+    recorded_seeds_.clear();
+    recorded_seeds_.shrink_to_fit();
+}
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "Buddha.h"
+
+Buddha::WorkerCounters Buddha::sum_counters(const WorkerCounters * from,
+                                            std::size_t n) const {
+    WorkerCounters sum = WorkerCounters();
+    for (std::size_t i = 0; i < n; ++i) {
+        const WorkerCounters & c = from[i];
+        sum.samples += __atomic_load_n(&c.samples, __ATOMIC_RELAXED);
+        sum.hinted += __atomic_load_n(&c.hinted, __ATOMIC_RELAXED);
+        sum.culled += __atomic_load_n(&c.culled, __ATOMIC_RELAXED);
+        sum.never_escaped += __atomic_load_n(&c.never_escaped, __ATOMIC_RELAXED);
+        sum.contributed += __atomic_load_n(&c.contributed, __ATOMIC_RELAXED);
+        sum.points += __atomic_load_n(&c.points, __ATOMIC_RELAXED);
+        sum.flushes += __atomic_load_n(&c.flushes, __ATOMIC_RELAXED);
+        sum.merge_wait_ns += __atomic_load_n(&c.merge_wait_ns, __ATOMIC_RELAXED);
+        sum.flush_ns += __atomic_load_n(&c.flush_ns, __ATOMIC_RELAXED);
+        sum.batches += __atomic_load_n(&c.batches, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+std::string Buddha::stats_line(const WorkerCounters & c) const {
+    double samples = c.samples > 0 ? c.samples : 1;
+
+    std::ostringstream msg;
+    msg << std::fixed << std::setprecision(2)
+        << "Stats: " << c.samples << " samples, "
+        << 100. * c.hinted / samples << "% hinted, "
+        << 100. * c.culled / samples << "% culled, "
+        << 100. * c.never_escaped / samples << "% never escaped, "
+        << 100. * c.contributed / samples << "% contributed, "
+        << c.points << " points in " << c.flushes << " flushes (";
+    if (Accumulation::ATOMIC == accumulation_)
+        msg << "n/a blocked), ";
+    else
+        msg << std::setprecision(3) << c.merge_wait_ns / 1e9 << " s blocked), ";
+    msg << c.batches << " batches";
+    return msg.str();
+}
+
+void Buddha::save_stats_report(double elapsed) {
+    std::ofstream out(stats_report_, std::ios::trunc);
+    if (!out.is_open()) {
+        log(LogPriority::WARNING, "Unable to write stats report " + stats_report_);
+        return;
+    }
+
+    const bool timed_wait = Accumulation::ATOMIC != accumulation_;
+    auto write_counters = [&out, timed_wait](const WorkerCounters & c) {
+        out << "{\"samples\": " << c.samples
+            << ", \"hinted\": " << c.hinted
+            << ", \"culled\": " << c.culled
+            << ", \"never_escaped\": " << c.never_escaped
+            << ", \"contributed\": " << c.contributed
+            << ", \"points\": " << c.points
+            << ", \"flushes\": " << c.flushes
+            << ", \"merge_wait_ns\": ";
+        if (timed_wait)
+            out << c.merge_wait_ns;
+        else
+            out << "null";
+        out << ", \"flush_ns\": " << c.flush_ns
+            << ", \"batches\": " << c.batches << "}";
+    };
+
+    out << std::setprecision(6)
+        << "{\"name\": \"" << name_ << "\""
+        << ", \"sampler\": \"" << sampler_name(sampler_) << "\""
+        << ", \"accumulation\": \"" << accumulation_name(accumulation_) << "\""
+        << ", \"kernel\": \"" << kernel_.name << "\""
+        << ", \"precision\": \"" << orbit_precision_name(kernel_.precision) << "\""
+        << ", \"threads\": " << num_threads_
+        << ", \"elapsed\": " << elapsed
+        << ",\n \"total\": ";
+    write_counters(sum_counters(counters_.data(), counters_.size()));
+
+    out << ",\n \"workers\": [";
+    for (std::size_t i = 0; i < counters_.size(); ++i) {
+        out << (i ? ",\n  " : "\n  ");
+        write_counters(counters_[i]);
+    }
+    out << "]}\n";
+
+    log(LogPriority::INFO, "Stats report saved to " + stats_report_);
+}
+
+void Buddha::progress_loop() {
+    typedef std::chrono::steady_clock clock;
+    auto stats_period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(stats_interval_));
+    auto next_progress = clock::now() + std::chrono::milliseconds(500);
+    auto next_stats = clock::now() + stats_period;
+    auto convergence_period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(convergence_interval_));
+    auto next_convergence = clock::now() + convergence_period;
+    double all = total_samples_;
+
+    std::unique_lock<std::mutex> lock(monitor_lock_);
+    while (!monitor_cv_.wait_for(lock, std::chrono::milliseconds(100),
+                                 [this]() { return monitor_stop_; })) {
+        if (clock::now() >= next_progress) {
+            next_progress += std::chrono::milliseconds(500);
+            log(LogPriority::NOTICE, "Done " + std::to_string(100. * progress_ / all) + "%");
+        }
+
+        if (stats_interval_ > 0 && clock::now() >= next_stats) {
+            next_stats += stats_period;
+            log(LogPriority::INFO, stats_line(sum_counters(counters_.data(), counters_.size())));
+        }
+
+        if (convergence_ > 0 && clock::now() >= next_convergence) {
+            lock.unlock();
+            double change = histogram_change();
+            lock.lock();
+            next_convergence = clock::now() + convergence_period;
+
+            if (!std::isinf(change)) {
+                log(LogPriority::DEBUG, "Histogram changed by " + std::to_string(change)
+                    + " since the last snapshot");
+                if (change < convergence_)
+                    request_stop("histogram changed by " + std::to_string(change)
+                                 + " since the last snapshot");
+            }
+        }
+    }
+}
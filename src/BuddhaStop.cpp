@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+
+static int64_t stop_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool Buddha::stop_requested() {
+    if (stop_requested_.load(std::memory_order_relaxed))
+        return true;
+
+    if (time_limit_ > 0 && stop_clock_ns() >= deadline_ns_) {
+        std::ostringstream reason;
+        reason << "time limit of " << time_limit_ << " s reached";
+        request_stop(reason.str());
+    } else if (sample_limit_ > 0 && progress_ >= sample_limit_) {
+        request_stop("sample limit of " + std::to_string(sample_limit_) + " reached");
+    }
+
+    return stop_requested_.load(std::memory_order_relaxed);
+}
+
+void Buddha::request_stop(const std::string & reason) {
+    if (!stop_requested_.exchange(true))
+        log(LogPriority::NOTICE, "Stopping " + filename_ + " early, " + reason);
+}
+
+double Buddha::histogram_change() {
+    /* Read twice, once for the total and once to compare, like a preview */
+    const uint64_t count = histogram_size();
+    const uint64_t chunk = 1 << 16;
+    std::vector<uint64_t> buffer(chunk);
+    HistogramReader read = histogram_reader();
+
+    double total = 0;
+    for (uint64_t from = 0; from < count; from += chunk) {
+        uint64_t n = std::min(chunk, count - from);
+        read(from, n, buffer.data());
+        for (uint64_t i = 0; i < n; ++i)
+            total += buffer[i];
+    }
+
+    /* Orbits reach data_ in flushes, there may be none since the last time */
+    if (0 == total || total == snapshot_total_)
+        return std::numeric_limits<double>::infinity();
+    snapshot_total_ = total;
+
+    bool first = snapshot_.empty();
+    if (first)
+        snapshot_.assign(count, 0);
+
+    /* L1 distance of the two histograms, each scaled to sum up to one */
+    double change = 0;
+    for (uint64_t from = 0; from < count; from += chunk) {
+        uint64_t n = std::min(chunk, count - from);
+        read(from, n, buffer.data());
+        for (uint64_t i = 0; i < n; ++i) {
+            float now = buffer[i] / total;
+            change += std::fabs(now - snapshot_[from + i]);
+            snapshot_[from + i] = now;
+        }
+    }
+
+    return first ? std::numeric_limits<double>::infinity() : change;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <chrono>
 #include <complex>
 #include <cstdint>
 #include <sstream>
@@ -6,61 +8,359 @@
 
 #include "Buddha.h"
 
-void Buddha::flush_data(std::vector<uint64_t> & local_data, uint64_t & filled) {
-    std::unique_lock<std::mutex> _(data_lock_);
+typedef std::chrono::steady_clock flush_clock;
 
-    for (uint64_t i = 0; i < filled; i++) {
-        data_[local_data[i]]++;
+
+static uint64_t elapsed_ns(flush_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        flush_clock::now() - since).count();
+}
+
+const uint64_t * Buddha::sort_local_data(WorkerState & state) {
+    std::vector<uint64_t> & offsets = state.bucket_offsets;
+
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint64_t i = 0; i < state.filled; ++i)
+        ++offsets[(state.local_data[i] >> bucket_shift_) + 1];
+    for (std::size_t b = 1; b < offsets.size(); ++b)
+        offsets[b] += offsets[b - 1];
+
+    /* offsets[b] moves on to the end of bucket b */
+    for (uint64_t i = 0; i < state.filled; ++i) {
+        uint64_t pos = state.local_data[i];
+        state.sorted[offsets[pos >> bucket_shift_]++] = pos;
     }
 
-    filled = 0;
+    return state.sorted.data();
 }
 
-void Buddha::worker(uint64_t from, uint64_t to) {
-    uint64_t filled = 0;
-    std::vector<uint64_t> local_data(thread_vector_size_);
-    std::size_t progress_local = 0;
+CompactHistogram & Buddha::flush_target(const WorkerState & state) {
+    if (Accumulation::PRIVATE == accumulation_)
+        return *private_data_[state.index];
+
+    return replicas_ > 0 ? *private_data_[state.node] : data_;
+}
+
+void Buddha::flush_data(WorkerState & state) {
+    auto start = flush_clock::now();
+
+    /* Striped flushes bucket by stripe themselves */
+    const uint64_t * local_data = state.local_data.data();
+    if (sorted_flush_ && Accumulation::STRIPED != accumulation_)
+        local_data = sort_local_data(state);
+    CompactHistogram & target = flush_target(state);
+
+    switch (accumulation_) {
+        case Accumulation::MUTEX: {
+            std::unique_lock<std::mutex> _(replicas_ > 0 ? replica_locks_[state.node]
+                                                         : data_lock_);
+            tally(state.counters->merge_wait_ns, elapsed_ns(start));
+
+            /* Readable by save_preview() at any time */
+            for (uint64_t i = 0; i < state.filled; i++) {
+                target.increment(local_data[i]);
+            }
+            break;
+        }
+
+        case Accumulation::STRIPED:
+            flush_striped(state);
+            break;
+
+        case Accumulation::ATOMIC:
+            for (uint64_t i = 0; i < state.filled; i++)
+                target.increment_atomic(local_data[i]);
+            break;
+
+        case Accumulation::PRIVATE:
+            for (uint64_t i = 0; i < state.filled; i++)
+                target.increment(local_data[i]);
+            break;
+    }
+
+    state.filled = 0;
+    tally(state.counters->flushes);
+    tally(state.counters->flush_ns, elapsed_ns(start));
+}
+
+void Buddha::flush_striped(WorkerState & state) {
+    const std::size_t stripes = stripes_;
+    std::mutex * locks = &stripe_locks_[replicas_ > 0 ? state.node * stripes : 0];
+    CompactHistogram & target = flush_target(state);
+    std::vector<uint64_t> & offsets = state.stripe_offsets;
+    std::vector<uint64_t> & cursors = state.stripe_cursors;
+
+    /* Bucket the orbit points by stripe so each lock is taken once */
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint64_t i = 0; i < state.filled; ++i)
+        ++offsets[state.local_data[i] / stripe_size_ + 1];
+    for (std::size_t s = 0; s < stripes; ++s)
+        offsets[s + 1] += offsets[s];
+
+    std::copy(offsets.begin(), offsets.end() - 1, cursors.begin());
+    for (uint64_t i = 0; i < state.filled; ++i) {
+        uint64_t pos = state.local_data[i];
+        state.sorted[cursors[pos / stripe_size_]++] = pos;
+    }
+
+    auto scatter = [&](std::size_t s) {
+        for (uint64_t i = offsets[s]; i < offsets[s + 1]; ++i)
+            target.increment(state.sorted[i]);
+    };
+
+    /* Threads start at different stripes and postpone the busy ones */
+    state.busy_stripes.clear();
+    std::size_t first = state.index * stripes / num_threads_;
+    for (std::size_t n = 0; n < stripes; ++n) {
+        std::size_t s = (first + n) % stripes;
+        if (offsets[s] == offsets[s + 1])
+            continue;
+
+        if (!locks[s].try_lock()) {
+            state.busy_stripes.push_back(s);
+            continue;
+        }
+
+        scatter(s);
+        locks[s].unlock();
+    }
+
+    for (std::size_t s : state.busy_stripes) {
+        auto start = flush_clock::now();
+        std::unique_lock<std::mutex> _(locks[s]);
+        tally(state.counters->merge_wait_ns, elapsed_ns(start));
+        scatter(s);
+    }
+}
+
+void Buddha::init_lane_batch(LaneBatch & batch, bool record) {
+    batch.c_re.resize(kernel_.lanes);
+    batch.c_im.resize(kernel_.lanes);
+    batch.escape.resize(kernel_.lanes);
+    batch.used = 0;
+    if (OrbitPrecision::DOUBLE_DOUBLE == kernel_.precision) {
+        batch.c_re_lo.resize(kernel_.lanes);
+        batch.c_im_lo.resize(kernel_.lanes);
+    }
+    if (!record)
+        return;
+
+    batch.orbit.resize(kernel_.lanes * orbit_stride_);
+    if (max_iterations_ > orbit_stride_) {
+        batch.z_re.resize(kernel_.lanes);
+        batch.z_im.resize(kernel_.lanes);
+        batch.z_re_lo.resize(kernel_.lanes);
+        batch.z_im_lo.resize(kernel_.lanes);
+        batch.steps.resize(kernel_.lanes);
+    }
+}
+
+void Buddha::run_kernel(const OrbitKernelParams & p, LaneBatch & batch, uint64_t * escape,
+                        uint64_t * orbit, OrbitState * state) const {
+    const bool lo = !batch.c_re_lo.empty();
+    kernel_.run(p, batch.c_re.data(), batch.c_im.data(),
+                lo ? batch.c_re_lo.data() : nullptr, lo ? batch.c_im_lo.data() : nullptr,
+                escape, orbit, orbit ? orbit_stride_ : 0, state);
+}
+
+void Buddha::init_worker_state(WorkerState & state) {
+    state.local_data.resize(thread_vector_size_);
+    state.filled = 0;
+    state.node = thread_nodes_[state.index];
+    state.counters = &counters_[state.index];
+
+    if (sorted_flush_) {
+        state.sorted.resize(thread_vector_size_);
+        state.bucket_offsets.resize((data_.size() >> bucket_shift_) + 2);
+    }
+
+    if (Accumulation::STRIPED == accumulation_) {
+        state.sorted.resize(thread_vector_size_);
+        state.stripe_offsets.resize(stripes_ + 1);
+        state.stripe_cursors.resize(stripes_);
+    }
+
+    /* In two pass mode only the replayed samples need orbit storage */
+    init_lane_batch(state.batch, !two_pass_);
+    if (two_pass_)
+        init_lane_batch(state.replay, true);
+}
+
+static void pad_lanes(std::vector<double> & c_re, std::vector<double> & c_im,
+                      std::size_t used, double escaping) {
+    /* Fill the rest of the batch with samples which escape right away */
+    for (std::size_t k = used; k < c_re.size(); ++k) {
+        c_re[k] = escaping;
+        c_im[k] = 0;
+    }
+}
+
+void Buddha::count_escape(WorkerState & state, uint64_t escape) const {
+    if (escape >= max_iterations_)
+        tally(state.counters->never_escaped);
+    else if (qualifies(escape))
+        tally(state.counters->contributed);
+}
+
+bool Buddha::qualifies(uint64_t escape) const {
+    for (const Channel & channel : channels_)
+        if (escape >= channel.min_iterations && escape < channel.max_iterations)
+            return true;
+    return false;
+}
+
+void Buddha::deposit_orbit(WorkerState & state, const uint64_t * orbit,
+                           uint64_t length, uint64_t escape) {
+    /* The flush buffer has room for a few pieces of orbit_stride_ points */
+    if (length > orbit_stride_) {
+        for (uint64_t from = 0; from < length; from += orbit_stride_)
+            deposit_orbit(state, orbit + from, std::min(orbit_stride_, length - from), escape);
+        return;
+    }
+
+    if (state.filled + length * channels_.size() >= thread_vector_size_)
+        flush_data(state);
+
+    uint64_t filled = state.filled;
+
+    /* One copy of the orbit for every channel its escape time falls into */
+    for (std::size_t c = 0; c < channels_.size(); ++c) {
+        const Channel & channel = channels_[c];
+        if (escape < channel.min_iterations || escape >= channel.max_iterations)
+            continue;
+
+        uint64_t offset = c * channel_size_;
+        for (uint64_t j = 0; j < length; ++j)
+            if (orbit[j] != orbit_outside)
+                state.local_data[state.filled++] = offset + orbit[j];
+    }
+
+    tally(state.counters->points, state.filled - filled);
+}
+
+void Buddha::trace_orbits(LaneBatch & batch, std::size_t used, bool escapes_known,
+                          const std::function<bool(std::size_t)> & wanted,
+                          const OrbitVisitor & visit) const {
+    if (max_iterations_ <= orbit_stride_) {
+        run_kernel(kernel_params_, batch, batch.escape.data(), batch.orbit.data(), nullptr);
+        for (std::size_t k = 0; k < used; ++k)
+            if (wanted(k))
+                visit(k, batch.orbit.data() + k * orbit_stride_, batch.escape[k]);
+        return;
+    }
+
+    if (!escapes_known)
+        run_kernel(kernel_params_, batch, batch.escape.data(), nullptr, nullptr);
+
+    uint64_t longest = 0;
+    for (std::size_t k = 0; k < used; ++k)
+        if (wanted(k))
+            longest = std::max(longest, batch.escape[k]);
+
+    /* Every chunk continues the orbits where the last one left them */
+    std::copy(batch.c_re.begin(), batch.c_re.end(), batch.z_re.begin());
+    std::copy(batch.c_im.begin(), batch.c_im.end(), batch.z_im.begin());
+    std::fill(batch.z_re_lo.begin(), batch.z_re_lo.end(), 0);
+    std::fill(batch.z_im_lo.begin(), batch.z_im_lo.end(), 0);
+    OrbitState z = { batch.z_re.data(), batch.z_im.data(),
+                     batch.z_re_lo.data(), batch.z_im_lo.data() };
+    OrbitKernelParams chunk = kernel_params_;
+
+    for (uint64_t done = 0; done < longest; done += orbit_stride_) {
+        chunk.max_iterations = std::min(orbit_stride_, longest - done);
+        run_kernel(chunk, batch, batch.steps.data(), batch.orbit.data(), &z);
+
+        for (std::size_t k = 0; k < used; ++k)
+            if (batch.escape[k] > done && wanted(k))
+                visit(k, batch.orbit.data() + k * orbit_stride_,
+                      std::min(chunk.max_iterations, batch.escape[k] - done));
+    }
+}
 
-    floating_type radius_sqr = radius_ * radius_;
-    floating_type subpixel_width  = 2 * radius_ / x_size_;
-    floating_type subpixel_height = 2 * radius_ / y_size_;
+void Buddha::record_lanes(WorkerState & state, LaneBatch & batch, bool replay) {
+    pad_lanes(batch.c_re, batch.c_im, batch.used, radius_);
+    trace_orbits(batch, batch.used, replay,
+        [&](std::size_t k) { return qualifies(batch.escape[k]); },
+        [&](std::size_t k, const uint64_t * points, uint64_t n) {
+            deposit_orbit(state, points, n, batch.escape[k]);
+        });
+
+    /* Two pass mode counted the samples in the first pass already */
+    for (std::size_t k = 0; k < batch.used && !replay; ++k) {
+        uint64_t pos = batch.escape[k];
+        count_escape(state, pos);
+        if (record_seeds_ && qualifies(pos))
+            state.seeds.push_back({ batch.c_re[k], batch.c_im[k] });
+    }
+
+    batch.used = 0;
+}
+
+void Buddha::trace_lanes(WorkerState & state) {
+    LaneBatch & batch = state.batch;
+
+    if (!two_pass_) {
+        record_lanes(state, batch, false);
+        return;
+    }
+
+    /* First pass only finds out which samples contribute */
+    pad_lanes(batch.c_re, batch.c_im, batch.used, radius_);
+    run_kernel(kernel_params_, batch, batch.escape.data(), nullptr, nullptr);
+
+    LaneBatch & replay = state.replay;
+    for (std::size_t k = 0; k < batch.used; ++k) {
+        count_escape(state, batch.escape[k]);
+        if (!qualifies(batch.escape[k]))
+            continue;
+        if (record_seeds_)
+            state.seeds.push_back({ batch.c_re[k], batch.c_im[k] });
+
+        replay.c_re[replay.used] = batch.c_re[k];
+        replay.c_im[replay.used] = batch.c_im[k];
+        if (!batch.c_re_lo.empty()) {
+            replay.c_re_lo[replay.used] = batch.c_re_lo[k];
+            replay.c_im_lo[replay.used] = batch.c_im_lo[k];
+        }
+        replay.escape[replay.used] = batch.escape[k];
+        if (++replay.used == kernel_.lanes)
+            record_lanes(state, replay, true);
+    }
+
+    batch.used = 0;
+}
+
+void Buddha::drain_lanes(WorkerState & state) {
+    if (state.batch.used > 0)
+        trace_lanes(state);
+
+    if (two_pass_ && state.replay.used > 0)
+        record_lanes(state, state.replay, true);
+}
+
+void Buddha::worker(uint64_t from, uint64_t to, WorkerState & state) {
+    LaneBatch & batch = state.batch;
+    std::size_t progress_local = 0;
 
     for (uint64_t sub_x = 0; sub_x < subpixel_resolution_; ++sub_x) {
         for (uint64_t sub_y = 0; sub_y < subpixel_resolution_; ++sub_y) {
             for (uint64_t i = from; i < to; ++i) {
 
                 ++progress_local;
+                tally(state.counters->samples);
 
-                if (filled + max_iterations_ >= thread_vector_size_)
-                    flush_data(local_data, filled);
-
-                complex_type c = lin2complex(i);
-                c.real(c.real() + sub_x * subpixel_width);
-                c.imag(c.imag() + sub_y * subpixel_height);
-                complex_type z = c;
+                complex_type c = subpixel2complex(i, sub_x, sub_y);
 
-                uint64_t pos = 0;
-                if (mandelbrot_hint(c))
+                if (symmetric_ && c.imag() <= 0)
                     continue;
 
-                while (z.real() * z.real() + z.imag() * z.imag() < radius_sqr
-                    && pos < max_iterations_) {
-                    // TODO: Possible optimization when computing abs(z)^2.
-
-                    uint64_t zpos = complex2lin(z);
-
-                    if (zpos < data_.size()) {
-                        local_data[filled + pos] = zpos;
-                    }
-
-                    z *= z;
-                    z += c;
-                    ++pos;
-                }
+                if (skip_seed(c, state))
+                    continue;
 
-                if (pos >= min_iterations_ && pos < max_iterations_) {
-                    filled += pos;
-                }
+                batch.c_re[batch.used] = c.real();
+                batch.c_im[batch.used] = c.imag();
+                if (++batch.used == kernel_.lanes)
+                    trace_lanes(state);
             }
 
             if (progress_local > 10000) {
@@ -70,5 +370,5 @@ void Buddha::worker(uint64_t from, uint64_t to) {
         }
     }
 
-    flush_data(local_data, filled);
+    progress_ += progress_local;
 }
@@ -0,0 +1,126 @@
+#include <algorithm>
+
+#include <sys/mman.h>
+
+#include "CompactHistogram.h"
+
+static const std::size_t huge_page = 2 << 20;
+
+std::string CompactHistogram::backing_name(Backing b) {
+    switch (b) {
+        case Backing::HEAP: return "heap";
+        case Backing::MAPPED: return "untouched pages";
+        case Backing::TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+        case Backing::HUGETLB: return "hugetlb pages";
+    }
+
+    return "unknown";
+}
+
+CompactHistogram::CompactHistogram(uint64_t size, bool huge_pages, bool untouched)
+  : low_(nullptr), size_(0), mapped_(0), backing_(Backing::HEAP), spilled_(0) {
+    reset(size, huge_pages, untouched);
+}
+
+CompactHistogram::~CompactHistogram() {
+    release();
+}
+
+void CompactHistogram::release() {
+    if (mapped_ > 0)
+        munmap(low_, mapped_);
+    else
+        delete[] low_;
+
+    low_ = nullptr;
+    mapped_ = 0;
+}
+
+void CompactHistogram::carry(uint64_t i, uint64_t high) {
+    uint32_t * page = __atomic_load_n(&pages_[i / spill_page], __ATOMIC_ACQUIRE);
+    if (!page) {
+        std::lock_guard<std::mutex> _(spill_lock_);
+        page = pages_[i / spill_page];
+        if (!page) {
+            spill_.emplace_back(new uint32_t[spill_page]());
+            page = spill_.back().get();
+            __atomic_store_n(&pages_[i / spill_page], page, __ATOMIC_RELEASE);
+            __atomic_store_n(&spilled_, 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    /* Neighbours of the same page may carry from other threads */
+    __atomic_fetch_add(&page[i % spill_page], (uint32_t)high, __ATOMIC_RELAXED);
+}
+
+void CompactHistogram::add(uint64_t i, uint64_t n) {
+    uint64_t sum = __atomic_load_n(&low_[i], __ATOMIC_RELAXED) + n;
+    __atomic_store_n(&low_[i], (uint32_t)sum, __ATOMIC_RELAXED);
+    if (sum >> 32)
+        carry(i, sum >> 32);
+}
+
+void CompactHistogram::accumulate(uint64_t from, uint64_t n, uint64_t * out) const {
+    for (uint64_t k = 0; k < n; ++k)
+        out[k] += get(from + k);
+}
+
+void CompactHistogram::reset(uint64_t size, bool huge_pages, bool untouched) {
+    release();
+    size_ = size;
+    backing_ = Backing::HEAP;
+
+    /* Anonymous mappings come zeroed */
+    std::size_t bytes = (size * sizeof(uint32_t) + huge_page - 1) / huge_page * huge_page;
+    void * map = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge_pages && size > 0) {
+        map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (MAP_FAILED != map)
+            backing_ = Backing::HUGETLB;
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    if (huge_pages && size > 0 && MAP_FAILED == map) {
+        /* Transparent huge pages need the range aligned to their size */
+        char * raw = static_cast<char *>(mmap(nullptr, bytes + huge_page,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (MAP_FAILED != raw) {
+            char * aligned = raw + (huge_page - (uintptr_t)raw % huge_page) % huge_page;
+            if (aligned > raw)
+                munmap(raw, aligned - raw);
+            munmap(aligned + bytes, raw + huge_page - aligned);
+            map = aligned;
+            if (0 == madvise(map, bytes, MADV_HUGEPAGE))
+                backing_ = Backing::TRANSPARENT_HUGE_PAGES;
+        }
+    }
+#endif
+    if (untouched && size > 0 && MAP_FAILED == map) {
+        map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED != map)
+            backing_ = Backing::MAPPED;
+    }
+
+    if (MAP_FAILED != map) {
+        low_ = static_cast<uint32_t *>(map);
+        mapped_ = bytes;
+    } else {
+        low_ = new uint32_t[size]();
+    }
+
+    pages_.assign((size + spill_page - 1) / spill_page, nullptr);
+    spill_.clear();
+    spilled_ = 0;
+}
+
+std::size_t CompactHistogram::bytes() const {
+    return bytes(size_) + spill_.size() * spill_page * sizeof(uint32_t);
+}
+
+std::size_t CompactHistogram::bytes(uint64_t size) {
+    return size * sizeof(uint32_t)
+        + (size + spill_page - 1) / spill_page * sizeof(uint32_t *);
+}
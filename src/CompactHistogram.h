@@ -0,0 +1,130 @@
+#ifndef _COMPACTHISTOGRAM_H
+#define _COMPACTHISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Histogram of 32-bit counters, half the memory of plain uint64_t counts.
+ * A counter that wraps around carries into its high word in a spill table
+ * of spill_page sized pages, allocated the first time a counter of the page
+ * wraps. Only the brightest pixels of very long renders ever get there.
+ *
+ * Counters are read and written with relaxed atomics, so get() is safe
+ * while workers write. A reader racing with a carry may see the count
+ * without the carry, which only matters for the approximate previews.
+ *
+ * With huge pages the counters sit in 2 MiB pages, from the hugetlb pool if
+ * the system reserved one and as transparent huge pages otherwise, so a
+ * large image needs far fewer TLB entries. Untouched counters are mapped
+ * without writing to them, so their pages land on the NUMA node of the
+ * first thread incrementing them rather than of the one allocating them.
+ */
+class CompactHistogram {
+public:
+    static const uint64_t spill_page = 4096;
+
+    /* Where the counters live */
+    enum class Backing {
+        HEAP, MAPPED, TRANSPARENT_HUGE_PAGES, HUGETLB
+    };
+
+    static std::string backing_name(Backing b);
+
+    explicit CompactHistogram(uint64_t size = 0, bool huge_pages = false,
+                              bool untouched = false);
+    ~CompactHistogram();
+
+    CompactHistogram(const CompactHistogram &) = delete;
+    CompactHistogram & operator=(const CompactHistogram &) = delete;
+
+    uint64_t size() const { return size_; }
+    Backing backing() const { return backing_; }
+
+    /* One writer per counter at a time, e.g. under a lock */
+    void increment(uint64_t i) {
+        uint32_t v = __atomic_load_n(&low_[i], __ATOMIC_RELAXED) + 1;
+        __atomic_store_n(&low_[i], v, __ATOMIC_RELAXED);
+        if (0 == v)
+            carry(i, 1);
+    }
+
+    /* Any number of concurrent writers */
+    void increment_atomic(uint64_t i) {
+        if (0 == __atomic_add_fetch(&low_[i], 1, __ATOMIC_RELAXED))
+            carry(i, 1);
+    }
+
+    /* One writer per counter at a time */
+    void add(uint64_t i, uint64_t n);
+
+    uint64_t get(uint64_t i) const {
+        uint64_t v = __atomic_load_n(&low_[i], __ATOMIC_RELAXED);
+        if (0 == __atomic_load_n(&spilled_, __ATOMIC_RELAXED))
+            return v;
+
+        const uint32_t * page = __atomic_load_n(&pages_[i / spill_page], __ATOMIC_ACQUIRE);
+        return page ? v + ((uint64_t)__atomic_load_n(&page[i % spill_page],
+                                                     __ATOMIC_RELAXED) << 32) : v;
+    }
+
+    /* Adds counters [from, from + n) to out */
+    void accumulate(uint64_t from, uint64_t n, uint64_t * out) const;
+
+    /* Size counters of zero, not while anyone else uses the histogram */
+    void reset(uint64_t size, bool huge_pages = false, bool untouched = false);
+
+    /* Bytes held, counters and spill pages */
+    std::size_t bytes() const;
+
+    /* Bytes of a histogram of size counters before anything spilled */
+    static std::size_t bytes(uint64_t size);
+
+private:
+    uint32_t * low_;
+    uint64_t size_;
+    /* Bytes mapped, 0 for counters from the heap */
+    std::size_t mapped_;
+    Backing backing_;
+    std::vector<uint32_t *> pages_;
+    std::vector<std::unique_ptr<uint32_t[]>> spill_;
+    std::mutex spill_lock_;
+    uint32_t spilled_;
+
+    void carry(uint64_t i, uint64_t high);
+    void release();
+};
+
+/*
+ * Where entry i of a row major histogram file, channels of pixels of
+ * width columns, lives among the counters of a render. A tile_bits of zero
+ * keeps the file order. Otherwise every channel of channel_size counters
+ * is cut into square tiles of side 1 << tile_bits, tiles_x of them per
+ * row, each stored contiguously in row major order.
+ */
+struct CounterLayout {
+    uint64_t width;
+    uint64_t pixels;
+    uint64_t channel_size;
+    uint64_t tiles_x;
+    uint32_t tile_bits;
+
+    uint64_t index(uint64_t i) const {
+        if (0 == tile_bits)
+            return i;
+
+        const uint64_t mask = (1ull << tile_bits) - 1;
+        uint64_t channel = i / pixels;
+        uint64_t y = i % pixels / width;
+        uint64_t x = i % pixels % width;
+        uint64_t tile = (y >> tile_bits) * tiles_x + (x >> tile_bits);
+        return channel * channel_size + (tile << (2 * tile_bits))
+            + ((y & mask) << tile_bits) + (x & mask);
+    }
+};
+
+#endif // _COMPACTHISTOGRAM_H
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -14,6 +15,90 @@ void ConfigLoader::report_error(std::string error, std::string code, std::size_t
               << std::string(pos != 0 ? pos - 1 : 0, ' ') << '^' << std::endl;
 }
 
+namespace {
+
+/* Just enough double-double arithmetic to read a decimal number exactly */
+struct DoubleDouble {
+    double hi;
+    double lo;
+};
+
+DoubleDouble quick_two_sum(double a, double b) {
+    double s = a + b;
+    return { s, b - (s - a) };
+}
+
+DoubleDouble two_sum(double a, double b) {
+    double s = a + b;
+    double bb = s - a;
+    return { s, (a - (s - bb)) + (b - bb) };
+}
+
+DoubleDouble add(DoubleDouble a, double b) {
+    DoubleDouble s = two_sum(a.hi, b);
+    return quick_two_sum(s.hi, s.lo + a.lo);
+}
+
+DoubleDouble multiply(DoubleDouble a, double b) {
+    double p = a.hi * b;
+    return quick_two_sum(p, std::fma(a.hi, b, -p) + a.lo * b);
+}
+
+DoubleDouble divide(DoubleDouble a, double b) {
+    double q = a.hi / b;
+    double p = q * b;
+    DoubleDouble r = two_sum(a.hi, -p);
+    r.lo += a.lo - std::fma(q, b, -p);
+    return quick_two_sum(q, (r.hi + r.lo) / b);
+}
+
+}
+
+bool ConfigLoader::parse_double_double(const std::string & s, double & hi, double & lo) {
+    std::size_t i = 0;
+    bool negative = i < s.size() && '-' == s[i];
+    if (i < s.size() && ('-' == s[i] || '+' == s[i]))
+        ++i;
+
+    DoubleDouble v = { 0., 0. };
+    long exponent = 0;
+    bool digits = false, point = false;
+    for (; i < s.size(); ++i) {
+        if ('.' == s[i] && !point) {
+            point = true;
+        } else if (s[i] >= '0' && s[i] <= '9') {
+            v = add(multiply(v, 10.), s[i] - '0');
+            exponent -= point;
+            digits = true;
+        } else {
+            break;
+        }
+    }
+    if (!digits)
+        return false;
+
+    if (i < s.size() && ('e' == s[i] || 'E' == s[i])) {
+        std::size_t end = 0;
+        try {
+            exponent += std::stol(s.substr(i + 1), &end);
+        } catch (std::exception &) {
+            return false;
+        }
+        i += 1 + end;
+    }
+    if (i != s.size() || exponent < -400 || exponent > 400)
+        return false;
+
+    for (; exponent > 0; --exponent)
+        v = multiply(v, 10.);
+    for (; exponent < 0; ++exponent)
+        v = divide(v, 10.);
+
+    hi = negative ? -v.hi : v.hi;
+    lo = negative ? -v.lo : v.lo;
+    return true;
+}
+
 void ParsingConfigFileException::regenerate() {
     /* is there anythink to print */
     if (!msg_.empty())
@@ -130,6 +215,58 @@ std::vector<ConfigLoader::param_type> ConfigLoader::load(std::string filename) {
                     e.set_error_message("Unable parse '" + value + ": " + exp.what());
                     throw e;
                 }
+            } else if ("height" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].height)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as integer: " + value);
+                    throw e;
+                }
+            } else if ("center" == key) {
+                std::istringstream oss(value);
+                std::string re, im;
+                if (!(oss >> re >> im)
+                    || !parse_double_double(re, p[section_name].center_re,
+                                            p[section_name].center_re_lo)
+                    || !parse_double_double(im, p[section_name].center_im,
+                                            p[section_name].center_im_lo)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Expected real and imaginary part: " + value);
+                    throw e;
+                }
+            } else if ("view width" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].view_width)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("aspect" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].aspect)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("seed grid" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].seed_grid)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as integer: " + value);
+                    throw e;
+                }
+            } else if ("contribution map" == key) {
+                if (!parse_bool(value, p[section_name].contribution_map)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
             } else if ("radius" == key) {
                 std::istringstream oss(value);
                 if (!(oss >> p[section_name].radius)) {
@@ -154,12 +291,32 @@ std::vector<ConfigLoader::param_type> ConfigLoader::load(std::string filename) {
                     e.set_error_message("Unable parse as double: " + value);
                     throw e;
                 }
+            } else if ("red iterations" == key || "green iterations" == key
+                       || "blue iterations" == key) {
+                Buddha::Channel channel;
+                channel.color = "red iterations" == key ? 0
+                    : "green iterations" == key ? 1 : 2;
+
+                std::istringstream oss(value);
+                if (!(oss >> channel.min_iterations >> channel.max_iterations)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Expected minimum and maximum iterations: " + value);
+                    throw e;
+                }
+
+                auto & channels = p[section_name].channels;
+                channels.erase(std::remove_if(channels.begin(), channels.end(),
+                    [&](const Buddha::Channel & c) { return c.color == channel.color; }),
+                    channels.end());
+                channels.push_back(channel);
             } else if ("subpixel resolution" == key) {
                 std::istringstream oss(value);
-                if (!(oss >> p[section_name].subpixel_resolution)) {
+                if (!(oss >> p[section_name].subpixel_resolution)
+                    || 0 == p[section_name].subpixel_resolution) {
                     ParsingConfigFileException e;
                     e.set_file(filename, ln + 1);
-                    e.set_error_message("Unable parse as double: " + value);
+                    e.set_error_message("Subpixel resolution has to be a positive integer: " + value);
                     throw e;
                 }
             } else if ("threads" == key) {
@@ -170,6 +327,264 @@ std::vector<ConfigLoader::param_type> ConfigLoader::load(std::string filename) {
                     e.set_error_message("Unable parse as double: " + value);
                     throw e;
                 }
+            } else if ("kernel" == key) {
+                p[section_name].kernel = value;
+            } else if ("precision" == key) {
+                if ("float" == value)
+                    p[section_name].precision = OrbitPrecision::FLOAT;
+                else if ("double" == value)
+                    p[section_name].precision = OrbitPrecision::DOUBLE;
+                else if ("double-double" == value)
+                    p[section_name].precision = OrbitPrecision::DOUBLE_DOUBLE;
+                else {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown precision: " + value);
+                    throw e;
+                }
+            } else if ("accumulation" == key) {
+                if ("mutex" == value)
+                    p[section_name].accumulation = Buddha::Accumulation::MUTEX;
+                else if ("striped" == value)
+                    p[section_name].accumulation = Buddha::Accumulation::STRIPED;
+                else if ("atomic" == value)
+                    p[section_name].accumulation = Buddha::Accumulation::ATOMIC;
+                else if ("private" == value)
+                    p[section_name].accumulation = Buddha::Accumulation::PRIVATE;
+                else {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown accumulation: " + value);
+                    throw e;
+                }
+            } else if ("sampler" == key) {
+                if ("grid" == value)
+                    p[section_name].sampler = Buddha::Sampler::GRID;
+                else if ("metropolis" == value)
+                    p[section_name].sampler = Buddha::Sampler::METROPOLIS;
+                else if ("sobol" == value)
+                    p[section_name].sampler = Buddha::Sampler::SOBOL;
+                else if ("halton" == value)
+                    p[section_name].sampler = Buddha::Sampler::HALTON;
+                else {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown sampler: " + value);
+                    throw e;
+                }
+            } else if ("seed order" == key) {
+                if ("row" == value)
+                    p[section_name].seed_order = Buddha::SeedOrder::ROW;
+                else if ("morton" == value)
+                    p[section_name].seed_order = Buddha::SeedOrder::MORTON;
+                else if ("hilbert" == value)
+                    p[section_name].seed_order = Buddha::SeedOrder::HILBERT;
+                else {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown seed order: " + value);
+                    throw e;
+                }
+            } else if ("samples" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].samples)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as integer: " + value);
+                    throw e;
+                }
+            } else if ("random seed" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].random_seed)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as integer: " + value);
+                    throw e;
+                }
+            } else if ("coloring" == key) {
+                try {
+                    p[section_name].schema = make_coloring_schema(value);
+                } catch (std::exception &) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown coloring: " + value);
+                    throw e;
+                }
+            } else if ("tone curve" == key) {
+                try {
+                    delete make_tone_curve(nullptr, value);
+                } catch (std::exception &) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown tone curve: " + value);
+                    throw e;
+                }
+                p[section_name].tone_curve = value;
+            } else if ("bit depth" == key) {
+                std::istringstream oss(value);
+                int depth;
+                if (!(oss >> depth) || (8 != depth && 16 != depth)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Bit depth has to be 8 or 16: " + value);
+                    throw e;
+                }
+                p[section_name].bit_depth = depth;
+            } else if ("save histogram" == key) {
+                if (!parse_bool(value, p[section_name].save_histogram)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
+            } else if ("recolor" == key) {
+                p[section_name].recolor = value;
+            } else if ("checkpoint" == key) {
+                p[section_name].checkpoint = value;
+            } else if ("checkpoint interval" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].checkpoint_interval)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("preview interval" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].preview_interval)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("preview progress" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].preview_progress)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("stats interval" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].stats_interval)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("stats report" == key) {
+                p[section_name].stats_report = value;
+            } else if ("memory limit" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].memory_limit)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as integer: " + value);
+                    throw e;
+                }
+            } else if ("time limit" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].time_limit)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("sample limit" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].sample_limit)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as integer: " + value);
+                    throw e;
+                }
+            } else if ("convergence" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].convergence)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("convergence interval" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].convergence_interval)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("seed cache" == key) {
+                p[section_name].seed_cache = value;
+            } else if ("log level" == key) {
+                if (!parse_log_priority(value, p[section_name].log_level)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown log level: " + value);
+                    throw e;
+                }
+            } else if ("periodicity tolerance" == key) {
+                std::istringstream oss(value);
+                if (!(oss >> p[section_name].periodicity_tolerance)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as double: " + value);
+                    throw e;
+                }
+            } else if ("interior map" == key) {
+                if (!parse_bool(value, p[section_name].interior_map)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
+            } else if ("symmetric sampling" == key) {
+                if (!parse_bool(value, p[section_name].symmetric)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
+            } else if ("two pass" == key) {
+                if (!parse_bool(value, p[section_name].two_pass)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
+            } else if ("histogram layout" == key) {
+                if ("row" == value)
+                    p[section_name].histogram_layout = Buddha::HistogramLayout::ROW;
+                else if ("tiled" == value)
+                    p[section_name].histogram_layout = Buddha::HistogramLayout::TILED;
+                else {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unknown histogram layout: " + value);
+                    throw e;
+                }
+            } else if ("sorted flush" == key) {
+                if (!parse_bool(value, p[section_name].sorted_flush)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
+            } else if ("numa" == key) {
+                if (!parse_bool(value, p[section_name].numa)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
+            } else if ("huge pages" == key) {
+                if (!parse_bool(value, p[section_name].huge_pages)) {
+                    ParsingConfigFileException e;
+                    e.set_file(filename, ln + 1);
+                    e.set_error_message("Unable parse as bool: " + value);
+                    throw e;
+                }
             } else {
                 ParsingConfigFileException e;
                 e.set_file(filename, ln + 1);
@@ -41,6 +41,22 @@ public:
                                    : end + 1
                        );
     }
+
+    /*
+     * Decimal number to hi + lo, hi is the double closest to it and lo
+     * carries the digits past it for the double-double kernels
+     */
+    static bool parse_double_double(const std::string & s, double & hi, double & lo);
+
+    static inline bool parse_bool(const std::string & s, bool & value) {
+        if ("true" == s || "yes" == s || "on" == s || "1" == s)
+            value = true;
+        else if ("false" == s || "no" == s || "off" == s || "0" == s)
+            value = false;
+        else
+            return false;
+        return true;
+    }
 };
 
 #endif // _CONFIGLOADER_H
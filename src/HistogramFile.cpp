@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HistogramFile.h"
+
+static const char histogram_magic[8] = { 'B', 'U', 'D', 'D', 'H', 'A', 'H', 'I' };
+
+HistogramHeader make_histogram_header() {
+    HistogramHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, histogram_magic, sizeof(h.magic));
+    h.version = histogram_file_version;
+    h.header_size = sizeof(h);
+    h.data_offset = sizeof(h);
+    return h;
+}
+
+void save_histogram(const std::string & filename, HistogramHeader header,
+                    const std::vector<const uint64_t *> & sources) {
+    save_histogram(filename, header, [&sources](uint64_t from, uint64_t n, uint64_t * out) {
+        std::fill(out, out + n, 0);
+        for (const uint64_t * source : sources)
+            for (uint64_t i = 0; i < n; ++i)
+                out[i] += source[from + i];
+    });
+}
+
+void save_histogram(const std::string & filename, HistogramHeader header,
+                    const HistogramReader & read) {
+    std::string tmp = filename + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        throw UnableOpenHistogramFileException();
+
+    header.data_offset = sizeof(header);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    const uint64_t chunk = 64 * 1024;
+    std::vector<uint64_t> buffer(chunk);
+    for (uint64_t from = 0; from < header.count; from += chunk) {
+        uint64_t n = std::min(chunk, header.count - from);
+        read(from, n, buffer.data());
+
+        out.write(reinterpret_cast<const char *>(buffer.data()),
+                  n * sizeof(uint64_t));
+    }
+
+    out.close();
+    if (!out || !replace_file(tmp, filename))
+        throw UnableOpenHistogramFileException();
+}
+
+static bool sync_path(const std::string & path, int flags) {
+    int fd = open(path.c_str(), O_RDONLY | flags);
+    if (fd < 0)
+        return false;
+    bool synced = 0 == fsync(fd);
+    close(fd);
+    return synced;
+}
+
+bool replace_file(const std::string & tmp, const std::string & filename) {
+    if (!sync_path(tmp, 0) || std::rename(tmp.c_str(), filename.c_str()) != 0)
+        return false;
+
+    std::size_t slash = filename.find_last_of('/');
+    std::string dir = std::string::npos == slash ? "."
+        : 0 == slash ? "/" : filename.substr(0, slash);
+    return sync_path(dir, O_DIRECTORY);
+}
+
+bool histogram_exists(const std::string & filename) {
+    struct stat st;
+    return 0 == stat(filename.c_str(), &st);
+}
+
+bool histograms_compatible(const HistogramHeader & a, const HistogramHeader & b) {
+    return a.width == b.width && a.height == b.height
+        && a.center_re == b.center_re && a.center_im == b.center_im
+        && a.center_re_lo == b.center_re_lo && a.center_im_lo == b.center_im_lo
+        && a.view_width == b.view_width && a.view_height == b.view_height
+        && a.seed_grid == b.seed_grid
+        && a.radius == b.radius
+        && a.max_iterations == b.max_iterations
+        && a.min_iterations == b.min_iterations
+        && a.subpixel_resolution == b.subpixel_resolution
+        && a.sampler == b.sampler
+        && a.symmetric == b.symmetric
+        && a.precision == b.precision
+        && a.channels == b.channels
+        && std::equal(a.channel_min, a.channel_min + max_channels, b.channel_min)
+        && std::equal(a.channel_max, a.channel_max + max_channels, b.channel_max)
+        && std::equal(a.channel_color, a.channel_color + max_channels, b.channel_color);
+}
+
+MappedHistogram::MappedHistogram(const std::string & filename)
+  : map_(MAP_FAILED), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw UnableOpenHistogramFileException();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(HistogramHeader)) {
+        close(fd);
+        throw InvalidHistogramFileException();
+    }
+
+    size_ = st.st_size;
+    map_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == map_)
+        throw UnableOpenHistogramFileException();
+
+    const HistogramHeader & h = header();
+    if (0 != std::memcmp(h.magic, histogram_magic, sizeof(h.magic))
+        || h.version != histogram_file_version
+        || h.channels < 1 || h.channels > max_channels
+        || h.count != h.width * h.height * h.channels
+        || h.data_offset + h.count * sizeof(uint64_t) > size_) {
+        munmap(map_, size_);
+        throw InvalidHistogramFileException();
+    }
+}
+
+MappedHistogram::~MappedHistogram() {
+    munmap(map_, size_);
+}
+
+const HistogramHeader & MappedHistogram::header() const {
+    return *static_cast<const HistogramHeader *>(map_);
+}
+
+const uint64_t * MappedHistogram::data() const {
+    return reinterpret_cast<const uint64_t *>(
+        static_cast<const char *>(map_) + header().data_offset);
+}
@@ -0,0 +1,119 @@
+#ifndef _HISTOGRAMFILE_H
+#define _HISTOGRAMFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+class UnableOpenHistogramFileException : public virtual std::exception { };
+
+class InvalidHistogramFileException : public virtual std::exception { };
+
+/* Histograms have up to one channel per colour, stored one after another */
+const uint32_t max_channels = 3;
+
+/* Channel colour of a single channel coloured by the ColoringSchema */
+const uint32_t channel_all_colors = 3;
+
+/*
+ * On-disk histogram: this header followed by channels * width * height
+ * native endian uint64_t counters at data_offset, so the file can be mapped
+ * and used as it is. Besides the render parameters the header records how far the
+ * sampler got, which is all that is needed to continue a render.
+ */
+struct HistogramHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    /* Image size and the window of the complex plane it shows */
+    uint64_t width;
+    uint64_t height;
+    double center_re;
+    double center_im;
+    double center_re_lo;
+    double center_im_lo;
+    double view_width;
+    double view_height;
+
+    /* Seeds come from a seed_grid^2 grid over [-radius, radius]^2 */
+    uint64_t seed_grid;
+    double radius;
+    uint64_t max_iterations;
+    uint64_t min_iterations;
+    uint64_t subpixel_resolution;
+    uint32_t sampler;
+    uint32_t symmetric;
+    uint32_t seed_order;
+    uint32_t channels;
+    uint64_t shard_index;
+    uint64_t shard_count;
+
+    /* Escape time range and output colour of every channel */
+    uint64_t channel_min[max_channels];
+    uint64_t channel_max[max_channels];
+    uint32_t channel_color[max_channels];
+    /* OrbitPrecision of the kernel */
+    uint32_t precision;
+    /*
+     * Number of shard files buddha-merge summed into this one, zero for a
+     * render. Merged files carry no sampler state to resume from.
+     */
+    uint32_t merged_shards;
+
+    /* Grid sampler: every scheduling unit before next_batch is sampled */
+    uint64_t next_batch;
+    /* Seeds sampled so far, by any sampler */
+    uint64_t samples_done;
+
+    uint64_t data_offset;
+    uint64_t count;
+};
+
+const uint32_t histogram_file_version = 8;
+
+HistogramHeader make_histogram_header();
+
+/*
+ * Writes the element-wise sum of sources (each header.count long) next to
+ * filename first and renames it over, so a crash never leaves a torn file.
+ */
+void save_histogram(const std::string & filename, HistogramHeader header,
+                    const std::vector<const uint64_t *> & sources);
+
+/* Same for counters read chunk by chunk, read(from, n, out) fills out[0, n) */
+typedef std::function<void(uint64_t, uint64_t, uint64_t *)> HistogramReader;
+void save_histogram(const std::string & filename, HistogramHeader header,
+                    const HistogramReader & read);
+
+/*
+ * Flushes tmp to disk, renames it over filename and flushes the directory
+ * entry, so the rename survives a power loss as well. False on any failure.
+ */
+bool replace_file(const std::string & tmp, const std::string & filename);
+
+bool histogram_exists(const std::string & filename);
+
+/* Whether two histograms were rendered with the same view and sampling */
+bool histograms_compatible(const HistogramHeader & a, const HistogramHeader & b);
+
+class MappedHistogram {
+public:
+    explicit MappedHistogram(const std::string & filename);
+    ~MappedHistogram();
+
+    MappedHistogram(const MappedHistogram &) = delete;
+    MappedHistogram & operator=(const MappedHistogram &) = delete;
+
+    const HistogramHeader & header() const;
+    const uint64_t * data() const;
+
+private:
+    void * map_;
+    std::size_t size_;
+};
+
+#endif // _HISTOGRAMFILE_H
@@ -0,0 +1,135 @@
+#include <cctype>
+#include <ctime>
+#include <iostream>
+#include <utility>
+
+#include "Logger.h"
+
+constexpr std::chrono::milliseconds Logger::wake_timeout;
+
+std::string log_priority_name(LogPriority p) {
+    switch (p) {
+        case LogPriority::ERROR: return "ERROR";
+        case LogPriority::WARNING: return "WARNING";
+        case LogPriority::NOTICE: return "NOTICE";
+        case LogPriority::INFO: return "INFO";
+        case LogPriority::DEBUG: return "DEBUG";
+    }
+    return "";
+}
+
+bool parse_log_priority(const std::string & name, LogPriority & p) {
+    for (LogPriority q : { LogPriority::ERROR, LogPriority::WARNING, LogPriority::NOTICE,
+                           LogPriority::INFO, LogPriority::DEBUG }) {
+        std::string n = log_priority_name(q);
+        for (auto & ch : n)
+            ch = std::tolower(ch);
+        if (n == name) {
+            p = q;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t ring_size(std::size_t capacity) {
+    uint64_t size = 2;
+    while (size < capacity)
+        size *= 2;
+    return size;
+}
+
+Logger::Logger(LogPriority level, std::size_t capacity)
+  : level_(level), mask_(ring_size(capacity) - 1), slots_(new Slot[mask_ + 1]),
+    tail_(0), head_(0), dropped_(0), stop_(false) {
+    for (uint64_t i = 0; i <= mask_; ++i)
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+
+    printer_ = std::thread(&Logger::printer, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> _(wake_lock_);
+        stop_ = true;
+    }
+    wake_cv_.notify_one();
+    printer_.join();
+}
+
+void Logger::log(LogPriority p, std::string msg) {
+    if (!enabled(p))
+        return;
+
+    /* Slot pos is free for this lap when its sequence equals pos */
+    uint64_t pos = tail_.load(std::memory_order_relaxed);
+    Slot * slot;
+    while (true) {
+        slot = &slots_[pos & mask_];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t lag = (int64_t)(sequence - pos);
+
+        if (0 == lag) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (lag < 0) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->time = std::chrono::system_clock::now();
+    slot->priority = p;
+    slot->message = std::move(msg);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    wake_cv_.notify_one();
+}
+
+bool Logger::print_next() {
+    Slot & slot = slots_[head_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != head_ + 1)
+        return false;
+
+    std::time_t ttp = std::chrono::system_clock::to_time_t(slot.time);
+    struct tm tm_now;
+    localtime_r(&ttp, &tm_now);
+    char time[32];
+    std::strftime(time, sizeof(time), "%a %b %e %H:%M:%S %Y", &tm_now);
+
+    auto & out = LogPriority::ERROR == slot.priority ? std::cerr : std::cout;
+    out << log_priority_name(slot.priority) << " " << time << "     "
+        << slot.message << std::endl;
+
+    slot.message.clear();
+    slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+}
+
+void Logger::printer() {
+    uint64_t reported = 0;
+
+    while (true) {
+        while (print_next())
+            ;
+
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported) {
+            std::cerr << "WARNING " << dropped - reported
+                      << " log lines dropped, log buffer full" << std::endl;
+            reported = dropped;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_lock_);
+        if (stop_)
+            break;
+        wake_cv_.wait_for(lock, wake_timeout);
+    }
+
+    /* Writers are gone once the owner destroys the logger */
+    while (print_next())
+        ;
+}
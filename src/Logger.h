@@ -0,0 +1,74 @@
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class LogPriority {
+    ERROR, WARNING, NOTICE, INFO, DEBUG
+};
+
+std::string log_priority_name(LogPriority p);
+
+/* "error", "warning", "notice", "info" or "debug" */
+bool parse_log_priority(const std::string & name, LogPriority & p);
+
+/*
+ * Bounded multi producer, single consumer log. Writers claim a slot of the
+ * ring with a compare and swap and never wait on a lock or on the printer:
+ * when the ring is full the line is dropped and counted instead. Lines less
+ * important than the level are discarded before they reach the ring.
+ *
+ * The printer thread sleeps until a writer wakes it, a wakeup lost to the race
+ * between its check and its wait only delays the line by wake_timeout.
+ * The destructor prints whatever is left and joins the printer.
+ */
+class Logger {
+public:
+    explicit Logger(LogPriority level = LogPriority::DEBUG, std::size_t capacity = 1024);
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger & operator=(const Logger &) = delete;
+
+    void log(LogPriority p, std::string msg);
+
+    bool enabled(LogPriority p) const { return p <= level_; }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        std::chrono::system_clock::time_point time;
+        LogPriority priority;
+        std::string message;
+    };
+
+    static constexpr std::chrono::milliseconds wake_timeout{ 100 };
+
+    const LogPriority level_;
+    const uint64_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    /* Writers claim slot tail_, the printer owns slot head_ */
+    std::atomic<uint64_t> tail_;
+    uint64_t head_;
+    std::atomic<uint64_t> dropped_;
+
+    std::mutex wake_lock_;
+    std::condition_variable wake_cv_;
+    bool stop_;
+    std::thread printer_;
+
+    /* Prints and releases the oldest line, false when there is none yet */
+    bool print_next();
+    void printer();
+};
+
+#endif // _LOGGER_H
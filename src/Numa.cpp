@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+#include "Numa.h"
+
+bool parse_cpu_list(const std::string & list, std::vector<int> & cpus) {
+    std::istringstream in(list);
+    std::string range;
+
+    while (std::getline(in, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty())
+            continue;
+
+        std::istringstream bounds(range);
+        int from, to;
+        char dash;
+        if (!(bounds >> from) || from < 0)
+            return false;
+        to = from;
+        if (bounds >> dash && ('-' != dash || !(bounds >> to) || to < from))
+            return false;
+        if (bounds >> dash)
+            return false;
+
+        for (int cpu = from; cpu <= to; ++cpu)
+            cpus.push_back(cpu);
+    }
+
+    return true;
+}
+
+NumaTopology numa_topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (0 != sched_getaffinity(0, sizeof(allowed), &allowed))
+        return NumaTopology();
+
+    NumaTopology topology;
+    std::vector<int> seen;
+
+    /* Node numbers may have gaps, e.g. with memory only nodes */
+    std::vector<int> online;
+    std::ifstream nodes("/sys/devices/system/node/online");
+    std::string list;
+    if (nodes && std::getline(nodes, list))
+        parse_cpu_list(list, online);
+
+    for (int node : online) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::vector<int> cpus;
+        if (!file || !std::getline(file, list) || !parse_cpu_list(list, cpus))
+            continue;
+
+        std::vector<int> usable;
+        for (int cpu : cpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                usable.push_back(cpu);
+                seen.push_back(cpu);
+            }
+        }
+
+        if (!usable.empty())
+            topology.node_cpus.push_back(usable);
+    }
+
+    /* Allowed CPUs sysfs did not mention, or no sysfs at all */
+    std::vector<int> rest;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed) && std::find(seen.begin(), seen.end(), cpu) == seen.end())
+            rest.push_back(cpu);
+
+    if (topology.node_cpus.empty() && !rest.empty())
+        topology.node_cpus.push_back(rest);
+    else if (!rest.empty())
+        topology.node_cpus[0].insert(topology.node_cpus[0].end(), rest.begin(), rest.end());
+
+    return topology;
+}
+
+ThreadPin::ThreadPin(int cpu) : pinned_(false) {
+    CPU_ZERO(&previous_);
+    if (cpu < 0 || cpu >= CPU_SETSIZE || 0 != sched_getaffinity(0, sizeof(previous_), &previous_))
+        return;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    pinned_ = 0 == sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+ThreadPin::~ThreadPin() {
+    if (pinned_)
+        sched_setaffinity(0, sizeof(previous_), &previous_);
+}
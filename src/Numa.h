@@ -0,0 +1,44 @@
+#ifndef _NUMA_H
+#define _NUMA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+/*
+ * CPUs of every NUMA node this process may run on, read from sysfs and the
+ * affinity mask, so there is no dependency on libnuma. Machines without
+ * sysfs node information show up as a single node holding every allowed
+ * CPU. Nodes without allowed CPUs are left out.
+ */
+struct NumaTopology {
+    std::vector<std::vector<int>> node_cpus;
+};
+
+NumaTopology numa_topology();
+
+/* Parses sysfs CPU lists such as "0-3,8,10-11", false on malformed input */
+bool parse_cpu_list(const std::string & list, std::vector<int> & cpus);
+
+/*
+ * Binds the calling thread to cpu for as long as it lives and then puts
+ * the previous mask back, threads of a shared pool run other work later
+ */
+class ThreadPin {
+public:
+    explicit ThreadPin(int cpu);
+    ~ThreadPin();
+
+    ThreadPin(const ThreadPin &) = delete;
+    ThreadPin & operator=(const ThreadPin &) = delete;
+
+    bool pinned() const { return pinned_; }
+
+private:
+    cpu_set_t previous_;
+    bool pinned_;
+};
+
+#endif // _NUMA_H
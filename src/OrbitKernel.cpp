@@ -0,0 +1,61 @@
+#include <string>
+#include <vector>
+
+#include "OrbitKernel.h"
+
+std::string orbit_precision_name(OrbitPrecision p) {
+    switch (p) {
+        case OrbitPrecision::FLOAT: return "float";
+        case OrbitPrecision::DOUBLE: return "double";
+        case OrbitPrecision::DOUBLE_DOUBLE: return "double-double";
+    }
+
+    return "unknown";
+}
+
+std::vector<OrbitKernel> orbit_kernels() {
+    bool avx2 = false;
+    bool avx512 = false;
+
+#if defined(BUDDHA_X86_KERNELS)
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+    avx512 = __builtin_cpu_supports("avx512f");
+#endif
+
+    const OrbitPrecision f = OrbitPrecision::FLOAT;
+    const OrbitPrecision d = OrbitPrecision::DOUBLE;
+    const OrbitPrecision dd = OrbitPrecision::DOUBLE_DOUBLE;
+
+    /* Ordered from the widest one within every precision */
+    return {
+        { "avx512", f,  32, &orbit_kernel_avx512_float, avx512 },
+        { "avx2",   f,  16, &orbit_kernel_avx2_float,   avx2 },
+        { "sse2",   f,   8, &orbit_kernel_sse2_float,   true },
+        { "avx512", d,  16, &orbit_kernel_avx512,       avx512 },
+        { "avx2",   d,   8, &orbit_kernel_avx2,         avx2 },
+        { "sse2",   d,   4, &orbit_kernel_sse2,         true },
+        { "avx512", dd, 16, &orbit_kernel_avx512_dd,    avx512 },
+        { "avx2",   dd,  8, &orbit_kernel_avx2_dd,      avx2 },
+        { "sse2",   dd,  4, &orbit_kernel_sse2_dd,      true },
+    };
+}
+
+OrbitKernel select_orbit_kernel(const std::string & name,
+                                OrbitPrecision precision) {
+    for (auto & k : orbit_kernels()) {
+        if (k.precision != precision)
+            continue;
+
+        if ("auto" == name && k.supported)
+            return k;
+
+        if (k.name == name) {
+            if (!k.supported)
+                throw UnsupportedOrbitKernelException();
+            return k;
+        }
+    }
+
+    throw UnknownOrbitKernelException();
+}
@@ -0,0 +1,159 @@
+#ifndef _ORBITKERNEL_H
+#define _ORBITKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+class UnknownOrbitKernelException : public virtual std::exception { };
+
+class UnsupportedOrbitKernelException : public virtual std::exception { };
+
+/*
+ * Number type the orbits are iterated in. Float doubles the lanes of every
+ * kernel for previews, double-double carries about 106 bits of mantissa for
+ * orbits which double can not follow. Double-double seeds may have low parts
+ * too, so Metropolis steps of a deep zoom pixel still move them.
+ */
+enum class OrbitPrecision {
+    FLOAT, DOUBLE, DOUBLE_DOUBLE
+};
+
+std::string orbit_precision_name(OrbitPrecision p);
+
+/* Position recorded for orbit points that fall outside of the image. */
+const uint64_t orbit_outside = UINT64_MAX;
+
+struct OrbitKernelParams {
+    double escape_radius_sqr;
+    uint64_t max_iterations;
+
+    /*
+     * Hoisted complex2car: x = (re - center_re) * scale_x + offset_x. The
+     * centre is subtracted in the precision of the kernel, double-double
+     * kernels add the low parts, so deep zooms keep the bits of the orbit.
+     */
+    double center_re;
+    double center_re_lo;
+    double center_im;
+    double center_im_lo;
+    double scale_x;
+    double offset_x;
+    double scale_y;
+    double offset_y;
+    uint64_t x_size;
+    uint64_t y_size;
+
+    /*
+     * Positions are y * x_size + x for a tile_shift of zero. Otherwise the
+     * image is cut into square tiles of side 1 << tile_shift, tiles_x of
+     * them per row, each tile stored contiguously in row major order.
+     */
+    uint32_t tile_shift;
+    uint64_t tiles_x;
+
+    /* Mirror points from the bottom half of the image to the top one */
+    bool fold_y;
+
+    /*
+     * Brent's cycle detection: lanes coming back within this (squared)
+     * distance of the orbit point saved at the last power of two iteration
+     * are bounded and reported as never escaping. Zero disables the check.
+     */
+    double periodicity_tolerance_sqr;
+};
+
+/*
+ * Orbits of the lanes part way through. A kernel run given a state starts
+ * from z instead of c and stores z back when it returns, so a long orbit
+ * can be recorded a chunk of max_iterations points at a time. The low
+ * parts are only used by double-double kernels and may be null otherwise.
+ * Runs with a state skip the periodicity check, the escape times are known
+ * from an earlier run by then.
+ */
+struct OrbitState {
+    double * z_re;
+    double * z_im;
+    double * z_re_lo;
+    double * z_im_lo;
+};
+
+/*
+ * Iterates kernel.lanes samples c = c_re + i c_im in lock-step. The number of
+ * iterations spent inside of the escape radius (capped by max_iterations) is
+ * stored to escape. When orbit is not null the linear position of every
+ * visited point is stored to orbit[lane * stride + iteration], stride has to
+ * be at least max_iterations. Entries past escape[lane] are left undefined.
+ * Double-double kernels add c_re_lo + i c_im_lo to the seeds, the others
+ * ignore them. The low parts and the state may be null.
+ */
+typedef void (*orbit_kernel_fn)(const OrbitKernelParams & p,
+                                const double * c_re, const double * c_im,
+                                const double * c_re_lo, const double * c_im_lo,
+                                uint64_t * escape,
+                                uint64_t * orbit, std::size_t stride,
+                                OrbitState * state);
+
+struct OrbitKernel {
+    std::string name;
+    OrbitPrecision precision;
+    std::size_t lanes;
+    orbit_kernel_fn run;
+    bool supported;
+};
+
+std::vector<OrbitKernel> orbit_kernels();
+
+/* "auto" picks the widest kernel supported by the running CPU. */
+OrbitKernel select_orbit_kernel(const std::string & name = "auto",
+                                OrbitPrecision precision = OrbitPrecision::DOUBLE);
+
+void orbit_kernel_sse2_float(const OrbitKernelParams & p,
+                             const double * c_re, const double * c_im,
+                             const double * c_re_lo, const double * c_im_lo,
+                             uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                             OrbitState * state);
+void orbit_kernel_sse2(const OrbitKernelParams & p,
+                       const double * c_re, const double * c_im,
+                       const double * c_re_lo, const double * c_im_lo,
+                       uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                       OrbitState * state);
+void orbit_kernel_sse2_dd(const OrbitKernelParams & p,
+                          const double * c_re, const double * c_im,
+                          const double * c_re_lo, const double * c_im_lo,
+                          uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                          OrbitState * state);
+void orbit_kernel_avx2_float(const OrbitKernelParams & p,
+                             const double * c_re, const double * c_im,
+                             const double * c_re_lo, const double * c_im_lo,
+                             uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                             OrbitState * state);
+void orbit_kernel_avx2(const OrbitKernelParams & p,
+                       const double * c_re, const double * c_im,
+                       const double * c_re_lo, const double * c_im_lo,
+                       uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                       OrbitState * state);
+void orbit_kernel_avx2_dd(const OrbitKernelParams & p,
+                          const double * c_re, const double * c_im,
+                          const double * c_re_lo, const double * c_im_lo,
+                          uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                          OrbitState * state);
+void orbit_kernel_avx512_float(const OrbitKernelParams & p,
+                               const double * c_re, const double * c_im,
+                               const double * c_re_lo, const double * c_im_lo,
+                               uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                               OrbitState * state);
+void orbit_kernel_avx512(const OrbitKernelParams & p,
+                         const double * c_re, const double * c_im,
+                         const double * c_re_lo, const double * c_im_lo,
+                         uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                         OrbitState * state);
+void orbit_kernel_avx512_dd(const OrbitKernelParams & p,
+                            const double * c_re, const double * c_im,
+                            const double * c_re_lo, const double * c_im_lo,
+                            uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                            OrbitState * state);
+
+#endif // _ORBITKERNEL_H
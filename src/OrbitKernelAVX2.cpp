@@ -0,0 +1,49 @@
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+
+typedef float vec_float __attribute__((vector_size(32)));
+typedef double vec_double __attribute__((vector_size(32)));
+
+template <typename VI>
+static inline bool any_lane(VI m) {
+#if defined(__AVX2__)
+    return !_mm256_testz_si256((__m256i)m, (__m256i)m);
+#else
+    for (unsigned k = 0; k < sizeof(VI) / sizeof(m[0]); ++k)
+        if (m[k])
+            return true;
+    return false;
+#endif
+}
+
+#include "OrbitKernelImpl.hpp"
+
+void orbit_kernel_avx2_float(const OrbitKernelParams & p,
+                             const double * c_re, const double * c_im,
+                             const double * c_re_lo, const double * c_im_lo,
+                             uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                             OrbitState * state) {
+    orbit_lanes<vec_float, vec_float, 2>(p, c_re, c_im, c_re_lo, c_im_lo,
+                                         escape, orbit, stride, state);
+}
+
+void orbit_kernel_avx2(const OrbitKernelParams & p,
+                       const double * c_re, const double * c_im,
+                       const double * c_re_lo, const double * c_im_lo,
+                       uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                       OrbitState * state) {
+    orbit_lanes<vec_double, vec_double, 2>(p, c_re, c_im, c_re_lo, c_im_lo,
+                                           escape, orbit, stride, state);
+}
+
+void orbit_kernel_avx2_dd(const OrbitKernelParams & p,
+                          const double * c_re, const double * c_im,
+                          const double * c_re_lo, const double * c_im_lo,
+                          uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                          OrbitState * state) {
+    orbit_lanes<dd_vec<vec_double>, vec_double, 2>(p, c_re, c_im, c_re_lo, c_im_lo,
+                                                   escape, orbit, stride, state);
+}
@@ -0,0 +1,293 @@
+#ifndef _ORBITKERNELIMPL_HPP
+#define _ORBITKERNELIMPL_HPP
+
+/*
+ * Shared body of the SIMD orbit kernels. Every OrbitKernel*.cpp is compiled
+ * with its own instruction set flags, defines any_lane() for its mask types
+ * and includes this file, so everything here has to stay internal to the
+ * translation unit.
+ */
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "OrbitKernel.h"
+
+namespace {
+
+/*
+ * Double-double number, hi + lo with |lo| <= ulp(hi) / 2, on whole vectors.
+ * Error free transformations after Dekker and Knuth, which rely on every
+ * operation being rounded on its own, hence -ffp-contract=off.
+ */
+template <typename VD>
+struct dd_vec {
+    VD hi;
+    VD lo;
+
+    dd_vec() : hi(), lo() { }
+    dd_vec(VD h) : hi(h), lo() { }
+    dd_vec(VD h, VD l) : hi(h), lo(l) { }
+};
+
+template <typename VD>
+inline dd_vec<VD> quick_two_sum(VD a, VD b) {
+    VD s = a + b;
+    return dd_vec<VD>(s, b - (s - a));
+}
+
+template <typename VD>
+inline dd_vec<VD> two_sum(VD a, VD b) {
+    VD s = a + b;
+    VD bb = s - a;
+    return dd_vec<VD>(s, (a - (s - bb)) + (b - bb));
+}
+
+template <typename VD>
+inline dd_vec<VD> two_prod(VD a, VD b) {
+    const VD splitter = VD() + 134217729.; // 2^27 + 1
+    VD p = a * b;
+    VD ta = splitter * a;
+    VD ah = ta - (ta - a);
+    VD al = a - ah;
+    VD tb = splitter * b;
+    VD bh = tb - (tb - b);
+    VD bl = b - bh;
+    return dd_vec<VD>(p, ((ah * bh - p) + ah * bl + al * bh) + al * bl);
+}
+
+template <typename VD>
+inline dd_vec<VD> operator+(const dd_vec<VD> & a, const dd_vec<VD> & b) {
+    dd_vec<VD> s = two_sum(a.hi, b.hi);
+    dd_vec<VD> t = two_sum(a.lo, b.lo);
+    s = quick_two_sum(s.hi, s.lo + t.hi);
+    return quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+template <typename VD>
+inline dd_vec<VD> operator-(const dd_vec<VD> & a, const dd_vec<VD> & b) {
+    return a + dd_vec<VD>(-b.hi, -b.lo);
+}
+
+template <typename VD>
+inline dd_vec<VD> operator*(const dd_vec<VD> & a, const dd_vec<VD> & b) {
+    dd_vec<VD> p = two_prod(a.hi, b.hi);
+    return quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+/* Vector of 64 bit image positions, one for every lane */
+template <int W> struct position_vec;
+template <> struct position_vec<2> {
+    typedef int64_t type __attribute__((vector_size(16)));
+};
+template <> struct position_vec<4> {
+    typedef int64_t type __attribute__((vector_size(32)));
+};
+template <> struct position_vec<8> {
+    typedef int64_t type __attribute__((vector_size(64)));
+};
+template <> struct position_vec<16> {
+    typedef int64_t type __attribute__((vector_size(128)));
+};
+
+/* Leading part of a number, enough for comparisons and pixel positions */
+template <typename VD>
+inline VD lead(VD v) {
+    return v;
+}
+
+template <typename VD>
+inline VD lead(const dd_vec<VD> & v) {
+    return v.hi;
+}
+
+/* What lead() leaves out, zero below double-double */
+template <typename VD>
+inline VD trail(VD) {
+    return VD();
+}
+
+template <typename VD>
+inline VD trail(const dd_vec<VD> & v) {
+    return v.lo;
+}
+
+/* Sets n to the number of the parts lead() and trail() returned */
+template <typename VD>
+inline void assemble(VD & n, VD hi, VD) {
+    n = hi;
+}
+
+template <typename VD>
+inline void assemble(dd_vec<VD> & n, VD hi, VD lo) {
+    n = dd_vec<VD>(hi, lo);
+}
+
+/*
+ * N is the number type the orbit is iterated in, either the GCC vector VD
+ * itself or dd_vec<VD>. U vectors are interleaved to hide the latency of
+ * the multiplications. Lanes which left the escape radius keep iterating
+ * with their mask cleared, so their counters and orbits stay put.
+ */
+template <typename N, typename VD, int U>
+inline void orbit_lanes(const OrbitKernelParams & p,
+                        const double * c_re, const double * c_im,
+                        const double * c_re_lo, const double * c_im_lo,
+                        uint64_t * escape,
+                        uint64_t * orbit, std::size_t stride,
+                        OrbitState * state) {
+    typedef decltype(VD() < VD()) VI;
+    typedef typename std::remove_reference<
+                decltype(std::declval<VD &>()[0])>::type T;
+    const int W = sizeof(VD) / sizeof(T);
+    typedef typename position_vec<sizeof(VD) / sizeof(T)>::type VL;
+
+    const VD zero = VD();
+    const VD radius_sqr = zero + (T)p.escape_radius_sqr;
+    N center_re, center_im;
+    assemble(center_re, zero + (T)p.center_re, zero + (T)p.center_re_lo);
+    assemble(center_im, zero + (T)p.center_im, zero + (T)p.center_im_lo);
+    const VD scale_x = zero + (T)p.scale_x;
+    const VD offset_x = zero + (T)p.offset_x;
+    const VD scale_y = zero + (T)p.scale_y;
+    const VD offset_y = zero + (T)p.offset_y;
+    const VD x_size = zero + (T)p.x_size;
+    const VD y_size = zero + (T)p.y_size;
+    const VL x_size_l = VL() + (int64_t)p.x_size;
+    const VL y_half_l = VL() + (int64_t)(p.y_size / 2);
+    const VL y_last_l = VL() + ((int64_t)p.y_size - 1);
+    const VL tiles_x_l = VL() + (int64_t)p.tiles_x;
+    const VL tile_mask_l = VL() + (int64_t)((1ull << p.tile_shift) - 1);
+    const bool periodicity = p.periodicity_tolerance_sqr > 0 && !state;
+    const VD tolerance = zero + (T)p.periodicity_tolerance_sqr;
+
+    N cr[U], ci[U], zr[U], zi[U], saved_r[U], saved_i[U];
+    VI active[U], count[U], interior[U];
+    uint64_t save_at = 1;
+
+    for (int u = 0; u < U; ++u) {
+        VD re, im, re_lo = VD(), im_lo = VD();
+        for (int k = 0; k < W; ++k) {
+            re[k] = c_re[u * W + k];
+            im[k] = c_im[u * W + k];
+            if (c_re_lo) {
+                re_lo[k] = c_re_lo[u * W + k];
+                im_lo[k] = c_im_lo[u * W + k];
+            }
+        }
+        assemble(cr[u], re, re_lo);
+        assemble(ci[u], im, im_lo);
+        zr[u] = saved_r[u] = cr[u];
+        zi[u] = saved_i[u] = ci[u];
+
+        if (state) {
+            VD hi_r, hi_i, lo_r = VD(), lo_i = VD();
+            for (int k = 0; k < W; ++k) {
+                hi_r[k] = state->z_re[u * W + k];
+                hi_i[k] = state->z_im[u * W + k];
+                if (state->z_re_lo) {
+                    lo_r[k] = state->z_re_lo[u * W + k];
+                    lo_i[k] = state->z_im_lo[u * W + k];
+                }
+            }
+            assemble(zr[u], hi_r, lo_r);
+            assemble(zi[u], hi_i, lo_i);
+        }
+        active[u] = VI() - 1;
+        count[u] = VI();
+        interior[u] = VI();
+    }
+
+    for (uint64_t it = 0; it < p.max_iterations; ++it) {
+        VI any = VI();
+
+        for (int u = 0; u < U; ++u) {
+            N zr2 = zr[u] * zr[u];
+            N zi2 = zi[u] * zi[u];
+            active[u] &= lead(zr2 + zi2) < radius_sqr;
+            count[u] -= active[u];
+
+            if (orbit) {
+                VD fx = lead(zr[u] - center_re) * scale_x + offset_x;
+                VD fy = lead(zi[u] - center_im) * scale_y + offset_y;
+                VI inside = (fx >= zero) & (fx < x_size)
+                          & (fy >= zero) & (fy < y_size);
+                fx = (VD)((VI)fx & inside);
+                fy = (VD)((VI)fy & inside);
+
+                /* Positions are 64 bit wide for lanes of any width */
+                VL in = __builtin_convertvector(inside, VL);
+                VL ix = __builtin_convertvector(fx, VL);
+                VL iy = __builtin_convertvector(fy, VL);
+
+                /* Rows of the bottom half onto the ones render() mirrors them from */
+                if (p.fold_y) {
+                    VL bottom = iy >= y_half_l;
+                    iy = (iy & ~bottom) | ((y_last_l - iy) & bottom);
+                }
+
+                VL pos;
+                if (0 == p.tile_shift) {
+                    pos = ix + iy * x_size_l;
+                } else {
+                    const int shift = p.tile_shift;
+                    pos = (((iy >> shift) * tiles_x_l + (ix >> shift)) << (2 * shift))
+                        | ((iy & tile_mask_l) << shift) | (ix & tile_mask_l);
+                }
+                pos |= ~in;
+
+                for (int k = 0; k < W; ++k)
+                    orbit[(u * W + k) * stride + it] = pos[k];
+            }
+
+            N re = zr2 - zi2 + cr[u];
+            zi[u] = (zr[u] + zr[u]) * zi[u] + ci[u];
+            zr[u] = re;
+
+            if (periodicity) {
+                VD dr = lead(zr[u] - saved_r[u]);
+                VD di = lead(zi[u] - saved_i[u]);
+                VI cycle = active[u] & (dr * dr + di * di < tolerance);
+                interior[u] |= cycle;
+                active[u] &= ~cycle;
+            }
+
+            any |= active[u];
+        }
+
+        if (!any_lane(any))
+            break;
+
+        if (periodicity && it + 1 == save_at) {
+            for (int u = 0; u < U; ++u) {
+                saved_r[u] = zr[u];
+                saved_i[u] = zi[u];
+            }
+            save_at *= 2;
+        }
+    }
+
+    for (int u = 0; u < U; ++u)
+        for (int k = 0; k < W; ++k)
+            escape[u * W + k] = interior[u][k] ? p.max_iterations : count[u][k];
+
+    if (state) {
+        for (int u = 0; u < U; ++u) {
+            VD hi_r = lead(zr[u]), hi_i = lead(zi[u]);
+            VD lo_r = trail(zr[u]), lo_i = trail(zi[u]);
+            for (int k = 0; k < W; ++k) {
+                state->z_re[u * W + k] = hi_r[k];
+                state->z_im[u * W + k] = hi_i[k];
+                if (state->z_re_lo) {
+                    state->z_re_lo[u * W + k] = lo_r[k];
+                    state->z_im_lo[u * W + k] = lo_i[k];
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+#endif // _ORBITKERNELIMPL_HPP
@@ -0,0 +1,53 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cstdint>
+
+typedef float vec_float __attribute__((vector_size(16)));
+typedef double vec_double __attribute__((vector_size(16)));
+
+static inline bool any_lane(decltype(vec_float() < vec_float()) m) {
+#if defined(__SSE2__)
+    return _mm_movemask_ps((__m128)m) != 0;
+#else
+    return m[0] || m[1] || m[2] || m[3];
+#endif
+}
+
+static inline bool any_lane(decltype(vec_double() < vec_double()) m) {
+#if defined(__SSE2__)
+    return _mm_movemask_pd((__m128d)m) != 0;
+#else
+    return m[0] || m[1];
+#endif
+}
+
+#include "OrbitKernelImpl.hpp"
+
+void orbit_kernel_sse2_float(const OrbitKernelParams & p,
+                             const double * c_re, const double * c_im,
+                             const double * c_re_lo, const double * c_im_lo,
+                             uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                             OrbitState * state) {
+    orbit_lanes<vec_float, vec_float, 2>(p, c_re, c_im, c_re_lo, c_im_lo,
+                                         escape, orbit, stride, state);
+}
+
+void orbit_kernel_sse2(const OrbitKernelParams & p,
+                       const double * c_re, const double * c_im,
+                       const double * c_re_lo, const double * c_im_lo,
+                       uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                       OrbitState * state) {
+    orbit_lanes<vec_double, vec_double, 2>(p, c_re, c_im, c_re_lo, c_im_lo,
+                                           escape, orbit, stride, state);
+}
+
+void orbit_kernel_sse2_dd(const OrbitKernelParams & p,
+                          const double * c_re, const double * c_im,
+                          const double * c_re_lo, const double * c_im_lo,
+                          uint64_t * escape, uint64_t * orbit, std::size_t stride,
+                          OrbitState * state) {
+    orbit_lanes<dd_vec<vec_double>, vec_double, 2>(p, c_re, c_im, c_re_lo, c_im_lo,
+                                                   escape, orbit, stride, state);
+}
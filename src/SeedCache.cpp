@@ -0,0 +1,82 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SeedCache.h"
+
+static const char seed_cache_magic[8] = { 'B', 'U', 'D', 'D', 'H', 'A', 'S', 'C' };
+
+SeedCacheHeader make_seed_cache_header() {
+    SeedCacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, seed_cache_magic, sizeof(h.magic));
+    h.version = seed_cache_version;
+    h.header_size = sizeof(h);
+    h.data_offset = sizeof(h);
+    return h;
+}
+
+void save_seed_cache(const std::string & filename, SeedCacheHeader header,
+                     const std::vector<CachedSeed> & seeds) {
+    std::string tmp = filename + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        throw UnableOpenSeedCacheException();
+
+    header.data_offset = sizeof(header);
+    header.count = seeds.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(seeds.data()),
+              seeds.size() * sizeof(CachedSeed));
+
+    out.close();
+    if (!out || !replace_file(tmp, filename))
+        throw UnableOpenSeedCacheException();
+}
+
+MappedSeedCache::MappedSeedCache(const std::string & filename)
+  : map_(MAP_FAILED), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw UnableOpenSeedCacheException();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(SeedCacheHeader)) {
+        close(fd);
+        throw InvalidSeedCacheException();
+    }
+
+    size_ = st.st_size;
+    map_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == map_)
+        throw UnableOpenSeedCacheException();
+
+    const SeedCacheHeader & h = header();
+    if (0 != std::memcmp(h.magic, seed_cache_magic, sizeof(h.magic))
+        || h.version != seed_cache_version
+        || h.ranges > max_channels
+        || h.data_offset + h.count * sizeof(CachedSeed) > size_) {
+        munmap(map_, size_);
+        throw InvalidSeedCacheException();
+    }
+}
+
+MappedSeedCache::~MappedSeedCache() {
+    munmap(map_, size_);
+}
+
+const SeedCacheHeader & MappedSeedCache::header() const {
+    return *static_cast<const SeedCacheHeader *>(map_);
+}
+
+const CachedSeed * MappedSeedCache::seeds() const {
+    return reinterpret_cast<const CachedSeed *>(
+        static_cast<const char *>(map_) + header().data_offset);
+}
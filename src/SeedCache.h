@@ -0,0 +1,74 @@
+#ifndef _SEEDCACHE_H
+#define _SEEDCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "HistogramFile.h"
+
+class UnableOpenSeedCacheException : public virtual std::exception { };
+
+class InvalidSeedCacheException : public virtual std::exception { };
+
+/* Version 1 symmetric recordings could lack the seeds on the real axis */
+const uint32_t seed_cache_version = 2;
+
+struct CachedSeed {
+    double re;
+    double im;
+};
+
+/*
+ * On-disk list of the seeds which contributed to a render: this header
+ * followed by count CachedSeed at data_offset. Escape times only depend on
+ * the bailout radius and the precision of the kernel, so the seeds are good
+ * for any view and colouring whose iteration ranges lie within the recorded
+ * ones. Symmetric renders record the upper half of the plane only, they
+ * only run on seed grids without a row on the real axis.
+ */
+struct SeedCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    double radius;
+    uint32_t precision;
+    uint32_t symmetric;
+
+    /* Seeds escaping within any of these [min, max) ranges */
+    uint32_t ranges;
+    uint32_t reserved;
+    uint64_t range_min[max_channels];
+    uint64_t range_max[max_channels];
+
+    uint64_t data_offset;
+    uint64_t count;
+};
+
+SeedCacheHeader make_seed_cache_header();
+
+/* Written next to filename first and renamed over, like histograms */
+void save_seed_cache(const std::string & filename, SeedCacheHeader header,
+                     const std::vector<CachedSeed> & seeds);
+
+/* Read-only mapping of a seed cache file */
+class MappedSeedCache {
+public:
+    explicit MappedSeedCache(const std::string & filename);
+    ~MappedSeedCache();
+
+    MappedSeedCache(const MappedSeedCache &) = delete;
+    MappedSeedCache & operator=(const MappedSeedCache &) = delete;
+
+    const SeedCacheHeader & header() const;
+    const CachedSeed * seeds() const;
+
+private:
+    void * map_;
+    std::size_t size_;
+};
+
+#endif // _SEEDCACHE_H
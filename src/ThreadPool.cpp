@@ -0,0 +1,60 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+  : task_(nullptr), generation_(0), next_(0), count_(0), running_(0), stop_(false) {
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> _(lock_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+
+    for (auto & t : threads_)
+        t.join();
+}
+
+void ThreadPool::run(std::size_t n, const std::function<void(std::size_t)> & task) {
+    if (0 == n)
+        return;
+
+    std::unique_lock<std::mutex> lock(lock_);
+    while (threads_.size() < n)
+        threads_.emplace_back(&ThreadPool::worker, this);
+
+    task_ = &task;
+    next_ = 0;
+    count_ = n;
+    running_ = n;
+    ++generation_;
+    start_cv_.notify_all();
+
+    done_cv_.wait(lock, [this]() { return 0 == running_; });
+    task_ = nullptr;
+}
+
+void ThreadPool::worker() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(lock_);
+
+    while (true) {
+        start_cv_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+        if (stop_)
+            return;
+
+        /* At most one task per round, they may wait for one another */
+        seen = generation_;
+        if (next_ >= count_)
+            continue;
+
+        std::size_t index = next_++;
+        const std::function<void(std::size_t)> & task = *task_;
+        lock.unlock();
+        task(index);
+        lock.lock();
+
+        if (0 == --running_)
+            done_cv_.notify_one();
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Persistent fork-join pool. run(n, task) calls task(0) ... task(n - 1)
+ * concurrently, each on a thread of its own, and returns when all are done.
+ * The pool grows to the largest n it was asked for, so tasks may wait for
+ * each other, e.g. on the checkpoint barrier. One run() at a time.
+ */
+class ThreadPool {
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    void run(std::size_t n, const std::function<void(std::size_t)> & task);
+
+    std::size_t size() const { return threads_.size(); }
+
+private:
+    std::vector<std::thread> threads_;
+
+    std::mutex lock_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(std::size_t)> * task_;
+    uint64_t generation_;
+    std::size_t next_;
+    std::size_t count_;
+    std::size_t running_;
+    bool stop_;
+
+    void worker();
+};
+
+#endif // _THREADPOOL_H
@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Buddha.h"
+#include "OrbitKernel.h"
+
+/*
+ * Fixed seed micro and macro benchmarks. Every result is one JSON object
+ * per line in the report, so runs can be collected and compared over time.
+ */
+
+static void usage(const char * program) {
+    std::cerr << "Usage: " << program
+              << " [--quick] [--threads <max>] [--json <report.json>]"
+              << " [--output <directory>]" << std::endl;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Keeps results of the timed calls from being optimised away */
+volatile uint64_t bench_sink;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+class BuddhaBench {
+public:
+    BuddhaBench(bool quick, std::size_t max_threads,
+                const std::string & json, const std::string & output);
+
+    void mandelbrot_hint();
+    void orbit_kernels();
+    void flush_data();
+    void histogram_layout();
+    void render();
+    void whole_render();
+
+private:
+    bool quick_;
+    double min_time_;
+    std::vector<std::size_t> threads_;
+    std::ofstream json_;
+    std::string output_;
+
+    Buddha::Params params(uint64_t width, std::size_t threads) const;
+    void report(const std::string & benchmark, const std::string & variant,
+                std::size_t threads, double value, const std::string & unit);
+};
+
+BuddhaBench::BuddhaBench(bool quick, std::size_t max_threads,
+                         const std::string & json, const std::string & output)
+  : quick_(quick), min_time_(quick ? .2 : 1.), json_(json), output_(output) {
+    if (!json_.is_open())
+        throw std::runtime_error("Unable to open " + json);
+
+    for (std::size_t t = 1; t < max_threads; t *= 2)
+        threads_.push_back(t);
+    threads_.push_back(max_threads);
+}
+
+Buddha::Params BuddhaBench::params(uint64_t width, std::size_t threads) const {
+    Buddha::Params p = Buddha::get_empty_params();
+    p.name = output_ + "/buddha_bench";
+    p.format = "ppm";
+    p.width = width;
+    p.radius = 2;
+    p.max_iterations = 2000;
+    p.min_iterations = 10;
+    p.subpixel_resolution = 2;
+    p.num_threads = threads;
+    p.save_histogram = false;
+    return p;
+}
+
+void BuddhaBench::report(const std::string & benchmark, const std::string & variant,
+                         std::size_t threads, double value, const std::string & unit) {
+    std::cout << std::left << std::setw(16) << benchmark << std::setw(30) << variant
+              << std::right << std::setw(4) << threads << " threads "
+              << std::fixed << std::setprecision(3) << std::setw(16) << value
+              << " " << unit << std::endl;
+
+    json_ << "{\"benchmark\": \"" << benchmark << "\", \"variant\": \"" << variant
+          << "\", \"threads\": " << threads << ", \"value\": "
+          << std::setprecision(6) << value << ", \"unit\": \"" << unit << "\"}"
+          << std::endl;
+}
+
+void BuddhaBench::mandelbrot_hint() {
+    std::unique_ptr<Buddha> b(new Buddha(params(64, 1)));
+
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> uniform(-2, 2);
+    std::vector<Buddha::complex_type> seeds(1 << 16);
+    for (auto & c : seeds)
+        c = Buddha::complex_type(uniform(rng), uniform(rng));
+
+    uint64_t calls = 0, hits = 0;
+    auto start = bench_clock::now();
+    do {
+        for (auto & c : seeds)
+            hits += b->mandelbrot_hint(c);
+        calls += seeds.size();
+    } while (seconds_since(start) < min_time_);
+
+    bench_sink = hits;
+
+    report("mandelbrot_hint", "uniform", 1,
+           calls / seconds_since(start) / 1e6, "Mcalls/s");
+}
+
+void BuddhaBench::orbit_kernels() {
+    std::mt19937_64 rng(2);
+    std::uniform_real_distribution<double> uniform(-2, 2);
+
+    for (auto & kernel : ::orbit_kernels()) {
+        if (!kernel.supported)
+            continue;
+
+        OrbitKernelParams p;
+        p.escape_radius_sqr = 4;
+        p.max_iterations = 1000;
+        p.scale_x = p.scale_y = 1024 / 4.;
+        p.offset_x = p.offset_y = 512;
+        p.center_re = p.center_re_lo = p.center_im = p.center_im_lo = 0;
+        p.x_size = p.y_size = 1024;
+        p.tile_shift = 0;
+        p.tiles_x = p.x_size;
+        p.fold_y = false;
+        p.periodicity_tolerance_sqr = 0;
+
+        std::vector<double> c_re(kernel.lanes * 256), c_im(kernel.lanes * 256);
+        for (std::size_t k = 0; k < c_re.size(); ++k) {
+            c_re[k] = uniform(rng);
+            c_im[k] = uniform(rng);
+        }
+        std::vector<uint64_t> escape(kernel.lanes);
+        std::vector<uint64_t> orbit(kernel.lanes * p.max_iterations);
+
+        for (bool record : { false, true }) {
+            /* Lanes iterate until the last of them escapes, so count those */
+            uint64_t iterations = 0;
+            auto start = bench_clock::now();
+            do {
+                for (std::size_t b = 0; b < c_re.size(); b += kernel.lanes) {
+                    kernel.run(p, &c_re[b], &c_im[b], nullptr, nullptr, escape.data(),
+                               record ? orbit.data() : nullptr, p.max_iterations, nullptr);
+                    iterations += kernel.lanes
+                        * *std::max_element(escape.begin(), escape.end());
+                }
+            } while (seconds_since(start) < min_time_);
+
+            report("orbit_kernel", kernel.name + "/"
+                   + orbit_precision_name(kernel.precision)
+                   + (record ? "/orbit" : "/escape"), 1,
+                   iterations / seconds_since(start) / 1e6, "Mlane-iterations/s");
+        }
+    }
+}
+
+void BuddhaBench::flush_data() {
+    const uint64_t width = quick_ ? 512 : 2048;
+    const uint64_t points = 1 << 20;
+
+    for (auto accumulation : { Buddha::Accumulation::MUTEX, Buddha::Accumulation::STRIPED,
+                               Buddha::Accumulation::ATOMIC, Buddha::Accumulation::PRIVATE }) {
+        for (std::size_t threads : threads_) {
+            Buddha::Params p = params(width, threads);
+            p.accumulation = accumulation;
+            std::unique_ptr<Buddha> b(new Buddha(p));
+            if (Buddha::Accumulation::PRIVATE == accumulation)
+                for (std::size_t t = 0; t < threads; ++t)
+                    b->private_data_.emplace_back(new CompactHistogram(b->data_.size()));
+
+            /* Orbits are runs of nearby points, not uniform noise */
+            std::vector<Buddha::WorkerState> states(threads);
+            for (std::size_t t = 0; t < threads; ++t) {
+                Buddha::WorkerState & state = states[t];
+                state.index = t;
+                b->init_worker_state(state);
+
+                std::mt19937_64 rng(3 + t);
+                uint64_t pos = rng() % b->data_.size();
+                for (uint64_t i = 0; i < points; ++i) {
+                    pos = (pos + rng() % (2 * width) + b->data_.size() - width)
+                        % b->data_.size();
+                    state.local_data[i] = pos;
+                }
+            }
+
+            std::vector<uint64_t> flushed(threads);
+            std::vector<std::thread> workers;
+            auto start = bench_clock::now();
+
+            for (std::size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t]() {
+                    Buddha::WorkerState & state = states[t];
+                    do {
+                        state.filled = points;
+                        b->flush_data(state);
+                        flushed[t] += points;
+                    } while (seconds_since(start) < min_time_);
+                });
+            }
+
+            for (auto & w : workers)
+                w.join();
+
+            uint64_t total = 0;
+            for (uint64_t f : flushed)
+                total += f;
+            report("flush_data", Buddha::accumulation_name(accumulation), threads,
+                   total / seconds_since(start) / 1e6, "Mpoints/s");
+        }
+    }
+}
+
+void BuddhaBench::histogram_layout() {
+    const std::vector<uint64_t> widths = quick_
+        ? std::vector<uint64_t>{ 2048 } : std::vector<uint64_t>{ 8192, 16384 };
+
+    for (uint64_t width : widths) {
+        /* Points of real orbits, in row major order */
+        std::vector<uint64_t> points;
+        {
+            Buddha::Params p = params(width, 1);
+            p.save_histogram = false;
+            std::unique_ptr<Buddha> b(new Buddha(p));
+            Buddha::LaneBatch batch;
+            b->init_lane_batch(batch, true);
+
+            std::mt19937_64 rng(5);
+            std::uniform_real_distribution<double> uniform(-2, 2);
+            const uint64_t wanted = b->thread_vector_size_;
+            while (points.size() < wanted) {
+                for (std::size_t k = 0; k < b->kernel_.lanes; ++k) {
+                    batch.c_re[k] = uniform(rng);
+                    batch.c_im[k] = uniform(rng);
+                }
+                b->trace_orbits(batch, b->kernel_.lanes, false,
+                    [&](std::size_t k) { return b->qualifies(batch.escape[k]); },
+                    [&](std::size_t, const uint64_t * orbit, uint64_t n) {
+                        for (uint64_t j = 0; j < n && points.size() < wanted; ++j)
+                            if (orbit[j] != orbit_outside)
+                                points.push_back(orbit[j]);
+                    });
+            }
+        }
+
+        for (auto layout : { Buddha::HistogramLayout::ROW, Buddha::HistogramLayout::TILED }) {
+            for (bool sorted : { false, true }) {
+                for (bool huge : { false, true }) {
+                    Buddha::Params p = params(width, 1);
+                    p.histogram_layout = layout;
+                    p.sorted_flush = sorted;
+                    p.huge_pages = huge;
+
+                    /* One histogram of this size at a time */
+                    std::unique_ptr<Buddha> b(new Buddha(p));
+                    Buddha::WorkerState state;
+                    state.index = 0;
+                    b->init_worker_state(state);
+                    for (std::size_t i = 0; i < points.size(); ++i)
+                        state.local_data[i] = b->counter_layout_.index(points[i]);
+
+                    /* The first flush faults the pages in */
+                    state.filled = points.size();
+                    b->flush_data(state);
+
+                    uint64_t flushed = 0;
+                    auto start = bench_clock::now();
+                    do {
+                        state.filled = points.size();
+                        b->flush_data(state);
+                        flushed += points.size();
+                    } while (seconds_since(start) < min_time_);
+
+                    report("flush_layout", std::to_string(width) + "/"
+                           + Buddha::histogram_layout_name(layout)
+                           + (sorted ? "/sorted" : "") + (huge ? "/huge" : ""), 1,
+                           flushed / seconds_since(start) / 1e6, "Mpoints/s");
+                }
+            }
+        }
+    }
+}
+
+void BuddhaBench::render() {
+    const uint64_t width = quick_ ? 1024 : 4096;
+
+    for (std::size_t threads : threads_) {
+        Buddha::Params p = params(width, threads);
+        p.schema = make_coloring_schema("gradient 000000 ff8000 ffffff");
+        std::unique_ptr<Buddha> b(new Buddha(p));
+
+        std::mt19937_64 rng(4);
+        std::geometric_distribution<uint64_t> counts(.01);
+        for (uint64_t i = 0; i < b->data_.size(); ++i)
+            b->data_.add(i, counts(rng));
+
+        uint64_t renders = 0;
+        auto start = bench_clock::now();
+        do {
+            b->render();
+            ++renders;
+        } while (seconds_since(start) < min_time_);
+
+        report("render", "gradient", threads,
+               renders * b->data_.size() / seconds_since(start) / 1e6, "Mpixels/s");
+    }
+}
+
+void BuddhaBench::whole_render() {
+    const uint64_t width = quick_ ? 200 : 400;
+
+    for (std::size_t threads : threads_) {
+        std::unique_ptr<Buddha> b(new Buddha(params(width, threads)));
+
+        auto start = bench_clock::now();
+        b->run();
+        double elapsed = seconds_since(start);
+
+        uint64_t points = 0;
+        for (uint64_t i = 0; i < b->data_.size(); ++i)
+            points += b->data_.get(i);
+
+        report("whole_render", "grid", threads, b->progress_ / elapsed / 1e6, "Msamples/s");
+        report("whole_render", "grid", threads, points / elapsed / 1e6, "Morbit-points/s");
+    }
+}
+
+int main(int argc, char * argv[]) {
+    try {
+        bool quick = false;
+        std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::string json = "buddha_bench.json";
+        std::string output = ".";
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (("--threads" == arg || "--json" == arg || "--output" == arg)
+                && i + 1 == argc) {
+                usage(argv[0]);
+                return 1;
+            }
+
+            if ("--quick" == arg)
+                quick = true;
+            else if ("--threads" == arg)
+                max_threads = std::max(1, std::atoi(argv[++i]));
+            else if ("--json" == arg)
+                json = argv[++i];
+            else if ("--output" == arg)
+                output = argv[++i];
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        BuddhaBench bench(quick, max_threads, json, output);
+        bench.mandelbrot_hint();
+        bench.orbit_kernels();
+        bench.flush_data();
+        bench.histogram_layout();
+        bench.render();
+        bench.whole_render();
+
+    } catch (std::exception & e) {
+        std::cerr << "EXCEPTION : " << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "UNKNOWN EXCEPTION" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,11 +1,49 @@
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "Buddha.h"
 #include "ConfigLoader.h"
 
+static void usage(const char * program) {
+    std::cerr << "Usage: " << program << " [--shard <index>/<count>] [config]"
+              << std::endl;
+}
+
+static bool parse_shard(const std::string & s, uint64_t & index, uint64_t & count) {
+    auto sep = s.find('/');
+    if (std::string::npos == sep)
+        return false;
+
+    try {
+        index = std::stoull(s.substr(0, sep));
+        count = std::stoull(s.substr(sep + 1));
+    } catch (std::exception &) {
+        return false;
+    }
+
+    return count > 0 && index < count;
+}
+
 int main(int argc, char * argv[]) {
     try {
-        if (1 == argc) {
+        uint64_t shard_index = 0;
+        uint64_t shard_count = 1;
+        std::vector<std::string> args;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if ("--shard" == arg) {
+                if (i + 1 == argc || !parse_shard(argv[++i], shard_index, shard_count)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+            } else {
+                args.push_back(arg);
+            }
+        }
+
+        if (args.empty()) {
             auto params = Buddha::get_empty_params();
 
             params.width = 512;
@@ -13,21 +51,24 @@ int main(int argc, char * argv[]) {
             params.max_iterations = 20;
             params.min_iterations = 5;
             params.subpixel_resolution = 3;
+            params.shard_index = shard_index;
+            params.shard_count = shard_count;
 
             Buddha b(params);
             b.run();
 
-        } else if (2 == argc) {
+        } else if (1 == args.size()) {
 
-            std::vector<ConfigLoader::param_type> ps = ConfigLoader::load(argv[1]);
+            std::vector<ConfigLoader::param_type> ps = ConfigLoader::load(args[0]);
             for (auto& p : ps) {
-                Buddha b(p);
-                b.run();
+                p.shard_index = shard_index;
+                p.shard_count = shard_count;
             }
 
+            Buddha::run_batch(ps);
+
         } else {
-            // TODO: Show usage
-            std::cerr << "Wrong number of arguments" << std::endl;
+            usage(argv[0]);
             return 1;
         }
 
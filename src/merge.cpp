@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Buddha.h"
+#include "HistogramFile.h"
+
+class IncompatibleHistogramsException : public virtual std::exception { };
+
+static void usage(const char * program) {
+    std::cerr << "Usage: " << program
+              << " [--coloring <schema>] [--tone <curve>] [--depth 8|16]"
+              << " [--histogram <merged.hist>]"
+              << " <image> <partial.hist>..." << std::endl;
+}
+
+/* Sums the partial histograms, every thread takes one slice of them */
+static std::vector<uint64_t> sum_histograms(
+    const std::vector<std::unique_ptr<MappedHistogram>> & parts) {
+    uint64_t size = parts.front()->header().count;
+    std::vector<uint64_t> sum(size);
+
+    std::size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t slice = (size + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            uint64_t from = std::min<uint64_t>(t * slice, size);
+            uint64_t to = std::min<uint64_t>(from + slice, size);
+            for (auto & part : parts) {
+                const uint64_t * data = part->data();
+                for (uint64_t i = from; i < to; ++i)
+                    sum[i] += data[i];
+            }
+        });
+    }
+
+    for (auto & t : threads)
+        t.join();
+
+    return sum;
+}
+
+int main(int argc, char * argv[]) {
+    try {
+        std::string coloring = "grayscale";
+        std::string tone;
+        int depth = 8;
+        std::string merged;
+        std::vector<std::string> args;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (("--coloring" == arg || "--tone" == arg || "--depth" == arg
+                 || "--histogram" == arg) && i + 1 == argc) {
+                usage(argv[0]);
+                return 1;
+            }
+
+            if ("--coloring" == arg)
+                coloring = argv[++i];
+            else if ("--tone" == arg)
+                tone = argv[++i];
+            else if ("--depth" == arg)
+                depth = std::atoi(argv[++i]);
+            else if ("--histogram" == arg)
+                merged = argv[++i];
+            else
+                args.push_back(arg);
+        }
+
+        if (args.size() < 2 || (8 != depth && 16 != depth)) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<MappedHistogram>> parts;
+        std::set<uint64_t> shards;
+        uint64_t samples = 0;
+
+        for (std::size_t i = 1; i < args.size(); ++i) {
+            parts.emplace_back(new MappedHistogram(args[i]));
+            const HistogramHeader & h = parts.back()->header();
+
+            if (!histograms_compatible(h, parts.front()->header()))
+                throw IncompatibleHistogramsException();
+
+            /* Shards of other splits or orders overlap, their sum counts seeds twice */
+            const HistogramHeader & first = parts.front()->header();
+            if (h.shard_count != first.shard_count || h.seed_order != first.seed_order) {
+                std::cerr << "ERROR: " << args[i] << " is a shard of another split "
+                          << "or seed order than " << args[1] << std::endl;
+                throw IncompatibleHistogramsException();
+            }
+
+            if (!shards.insert(h.shard_index).second) {
+                std::cerr << "ERROR: shard " << h.shard_index
+                          << " given more than once" << std::endl;
+                throw IncompatibleHistogramsException();
+            }
+            samples += h.samples_done;
+        }
+
+        HistogramHeader header = parts.front()->header();
+        if (shards.size() != header.shard_count)
+            std::cerr << "WARNING: merging " << shards.size() << " of "
+                      << header.shard_count << " shards" << std::endl;
+
+        std::vector<uint64_t> sum = sum_histograms(parts);
+
+        if (!merged.empty()) {
+            header.shard_index = 0;
+            header.shard_count = 1;
+            header.next_batch = 0;
+            header.samples_done = samples;
+            header.merged_shards = parts.size();
+            save_histogram(merged, header, { sum.data() });
+        }
+
+        std::unique_ptr<ColoringSchema> schema(make_coloring_schema(coloring));
+        std::unique_ptr<ColoringSchema> toned;
+        if (!tone.empty())
+            toned.reset(make_tone_curve(schema.get(), tone));
+        const ColoringSchema & colors = toned ? *toned : *schema;
+
+        if (16 == depth)
+            render_histogram16(header, sum.data(), colors).save(args[0].c_str());
+        else
+            render_histogram(header, sum.data(), colors).save(args[0].c_str());
+
+    } catch (std::exception & e) {
+        std::cerr << "EXCEPTION : " << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "UNKNOWN EXCEPTION" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include <iostream>
+
+/*
+ * Minimal checks for the test programs: a failed CHECK reports itself and
+ * the program exits with the number of failures from check_result().
+ */
+inline int & check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" \
+                      << std::endl; \
+            ++check_failures(); \
+        } \
+    } while (0)
+
+inline int check_result() {
+    if (check_failures() > 0)
+        std::cerr << check_failures() << " checks failed" << std::endl;
+    return check_failures() > 0 ? 1 : 0;
+}
+
+#endif // _CHECK_H
@@ -0,0 +1,46 @@
+#ifndef _FIXTURE_H
+#define _FIXTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "HistogramFile.h"
+
+/*
+ * Small renders for the test programs: a quiet 96x64 view of the whole set
+ * written to name.ppm and name.hist in the working directory.
+ */
+inline Buddha::Params test_params(const std::string & name) {
+    Buddha::Params p = Buddha::get_empty_params();
+    p.name = name;
+    p.format = "ppm";
+    p.width = 96;
+    p.height = 64;
+    p.radius = 2;
+    p.max_iterations = 200;
+    p.min_iterations = 2;
+    p.num_threads = 2;
+    p.log_level = LogPriority::ERROR;
+    return p;
+}
+
+/* Counts of a histogram file in file order, and optionally its samples */
+inline std::vector<uint64_t> load_counts(const std::string & filename,
+                                         uint64_t * samples_done = nullptr) {
+    MappedHistogram h(filename);
+    if (samples_done)
+        *samples_done = h.header().samples_done;
+    return std::vector<uint64_t>(h.data(), h.data() + h.header().count);
+}
+
+/* Image, histogram and checkpoint a test render may have left behind */
+inline void remove_outputs(const std::string & name) {
+    std::remove((name + ".ppm").c_str());
+    std::remove((name + ".hist").c_str());
+    std::remove((name + ".ckpt").c_str());
+}
+
+#endif // _FIXTURE_H
@@ -0,0 +1,102 @@
+/*
+ * Counters of a CompactHistogram have to carry into their spill pages
+ * exactly once per wrap, whichever way they are written, and read back as
+ * full 64 bit counts through get() and accumulate().
+ */
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "CompactHistogram.h"
+
+namespace {
+
+const uint64_t wrap = 1ull << 32;
+
+void check_add() {
+    CompactHistogram h(3 * CompactHistogram::spill_page);
+    CHECK(h.bytes() == CompactHistogram::bytes(h.size()));
+
+    /* Just below, onto and past the wrap, and several wraps at once */
+    h.add(0, wrap - 1);
+    CHECK(h.get(0) == wrap - 1);
+    h.add(0, 1);
+    CHECK(h.get(0) == wrap);
+    h.add(0, wrap + 5);
+    CHECK(h.get(0) == 2 * wrap + 5);
+
+    const uint64_t big = 7 * wrap + 123;
+    h.add(CompactHistogram::spill_page + 1, big);
+    CHECK(h.get(CompactHistogram::spill_page + 1) == big);
+
+    /* Neighbours on the same spill page keep their own high words */
+    CHECK(h.get(1) == 0);
+    h.add(1, 42);
+    CHECK(h.get(1) == 42);
+    CHECK(h.get(CompactHistogram::spill_page) == 0);
+
+    /* Only the pages with a wrapped counter are allocated */
+    CHECK(h.bytes() == CompactHistogram::bytes(h.size())
+          + 2 * CompactHistogram::spill_page * sizeof(uint32_t));
+
+    std::vector<uint64_t> out(h.size(), 1);
+    h.accumulate(0, h.size(), &out[0]);
+    CHECK(out[0] == 2 * wrap + 6);
+    CHECK(out[1] == 43);
+    CHECK(out[CompactHistogram::spill_page + 1] == big + 1);
+    CHECK(out[2 * CompactHistogram::spill_page] == 1);
+
+    h.reset(h.size());
+    CHECK(h.get(0) == 0);
+    CHECK(h.get(CompactHistogram::spill_page + 1) == 0);
+}
+
+void check_increment() {
+    CompactHistogram h(16);
+    h.add(3, wrap - 2);
+    h.increment(3);
+    CHECK(h.get(3) == wrap - 1);
+    h.increment(3);
+    CHECK(h.get(3) == wrap);
+    h.increment(3);
+    CHECK(h.get(3) == wrap + 1);
+
+    h.add(4, 2 * wrap - 1);
+    h.increment_atomic(4);
+    CHECK(h.get(4) == 2 * wrap);
+}
+
+/* Threads wrapping the same counter together carry it exactly once */
+void check_concurrent_carry() {
+    const std::size_t threads = 4;
+    const uint64_t per_thread = 1 << 16;
+    CompactHistogram h(CompactHistogram::spill_page);
+    h.add(0, wrap - per_thread * threads / 2);
+    h.add(1, wrap - 1);
+
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&]() {
+            for (uint64_t i = 0; i < per_thread; ++i) {
+                h.increment_atomic(0);
+                h.increment_atomic(1);
+            }
+        });
+    for (auto & w : workers)
+        w.join();
+
+    CHECK(h.get(0) == wrap + per_thread * threads / 2);
+    CHECK(h.get(1) == wrap - 1 + per_thread * threads);
+}
+
+} // namespace
+
+int main() {
+    check_add();
+    check_increment();
+    check_concurrent_carry();
+
+    return check_result();
+}
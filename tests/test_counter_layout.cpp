@@ -0,0 +1,132 @@
+/*
+ * Tiled histograms: CounterLayout has to map file order one to one onto
+ * the counters, the kernels have to write the positions it maps to, and a
+ * tiled render has to save the same histogram file as a row major one.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "Check.h"
+#include "CompactHistogram.h"
+#include "Fixture.h"
+#include "OrbitKernel.h"
+
+namespace {
+
+CounterLayout make_layout(uint64_t width, uint64_t height, uint32_t tile_bits) {
+    const uint64_t side = 1ull << tile_bits;
+    CounterLayout l;
+    l.width = width;
+    l.pixels = width * height;
+    l.tiles_x = (width + side - 1) / side;
+    l.tile_bits = tile_bits;
+    l.channel_size = l.tiles_x * ((height + side - 1) / side) * side * side;
+    return l;
+}
+
+/* Every entry of every channel gets a counter of its own, inside its channel */
+void check_one_to_one(uint64_t width, uint64_t height, uint32_t tile_bits) {
+    const uint64_t channels = 2;
+    CounterLayout l = make_layout(width, height, tile_bits);
+    std::vector<bool> used(channels * l.channel_size);
+    bool ok = true;
+
+    for (uint64_t i = 0; i < channels * l.pixels; ++i) {
+        uint64_t k = l.index(i);
+        ok = ok && k < used.size() && !used[k] && k / l.channel_size == i / l.pixels;
+        if (k < used.size())
+            used[k] = true;
+    }
+    CHECK(ok);
+}
+
+/* Positions of a tiled run are those of a row major run through the layout */
+void check_kernel_positions(const OrbitKernel & kernel, bool fold_y) {
+    OrbitKernelParams p = OrbitKernelParams();
+    p.escape_radius_sqr = 4.;
+    p.max_iterations = 200;
+    p.x_size = 100;
+    p.y_size = 70;
+    p.center_re = -.5;
+    p.scale_x = p.x_size / 3.;
+    p.offset_x = p.x_size / 2.;
+    p.scale_y = p.y_size / 3.;
+    p.offset_y = p.y_size / 2.;
+    p.tiles_x = p.x_size;
+    p.fold_y = fold_y;
+
+    const uint32_t tile_bits = 3;
+    CounterLayout l = make_layout(p.x_size, p.y_size, tile_bits);
+    OrbitKernelParams tiled = p;
+    tiled.tile_shift = tile_bits;
+    tiled.tiles_x = l.tiles_x;
+
+    std::vector<double> c_re(kernel.lanes), c_im(kernel.lanes);
+    for (std::size_t k = 0; k < kernel.lanes; ++k) {
+        c_re[k] = -1.9 + 2.4 * k / kernel.lanes;
+        c_im[k] = .05 + .6 * k / kernel.lanes;
+    }
+
+    const std::size_t stride = p.max_iterations;
+    std::vector<uint64_t> escape(kernel.lanes), row(kernel.lanes * stride);
+    std::vector<uint64_t> tiled_escape(kernel.lanes), tiles(kernel.lanes * stride);
+    kernel.run(p, &c_re[0], &c_im[0], nullptr, nullptr, &escape[0], &row[0], stride, nullptr);
+    kernel.run(tiled, &c_re[0], &c_im[0], nullptr, nullptr,
+               &tiled_escape[0], &tiles[0], stride, nullptr);
+
+    bool ok = escape == tiled_escape;
+    uint64_t inside = 0;
+    for (std::size_t k = 0; k < kernel.lanes && ok; ++k) {
+        for (uint64_t j = 0; j < escape[k]; ++j) {
+            uint64_t r = row[k * stride + j];
+            uint64_t t = tiles[k * stride + j];
+            ok = ok && (orbit_outside == r ? orbit_outside == t : t == l.index(r));
+            inside += orbit_outside != r;
+        }
+    }
+    CHECK(ok);
+    CHECK(inside > 0);
+}
+
+std::vector<uint64_t> render(Buddha::HistogramLayout layout, const std::string & name) {
+    Buddha::Params p = test_params(name);
+    p.width = 150;
+    p.height = 100;
+    p.channels.push_back(Buddha::Channel{ 2, 50, 0 });
+    p.channels.push_back(Buddha::Channel{ 50, 200, 1 });
+    p.histogram_layout = layout;
+    Buddha(p).run();
+
+    std::vector<uint64_t> counts = load_counts(name + ".hist");
+    remove_outputs(name);
+    return counts;
+}
+
+} // namespace
+
+int main() {
+    check_one_to_one(64, 64, 3);
+    check_one_to_one(100, 70, 3);
+    check_one_to_one(1, 129, 6);
+    check_one_to_one(130, 1, 6);
+
+    for (const OrbitKernel & kernel : orbit_kernels()) {
+        if (!kernel.supported)
+            continue;
+        std::cout << kernel.name << " " << orbit_precision_name(kernel.precision) << std::endl;
+        check_kernel_positions(kernel, false);
+        check_kernel_positions(kernel, true);
+    }
+
+    std::vector<uint64_t> row = render(Buddha::HistogramLayout::ROW, "test_counter_layout_row");
+    std::vector<uint64_t> tiled = render(Buddha::HistogramLayout::TILED,
+                                         "test_counter_layout_tiled");
+    CHECK(!row.empty());
+    CHECK(row == tiled);
+
+    return check_result();
+}
@@ -0,0 +1,251 @@
+/*
+ * Compares every orbit kernel the CPU supports with a plain scalar loop
+ * doing the same arithmetic one sample at a time. Both sides round every
+ * operation on its own (-ffp-contract=off), so escape times and positions
+ * have to match exactly, for whole runs, runs chunked through an OrbitState
+ * and seeds with low parts.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "Check.h"
+#include "OrbitKernel.h"
+
+namespace {
+
+/* Scalar double-double, the same operation sequence as dd_vec */
+struct Dd {
+    double hi;
+    double lo;
+
+    Dd(double h = 0., double l = 0.) : hi(h), lo(l) { }
+};
+
+Dd quick_two_sum(double a, double b) {
+    double s = a + b;
+    return Dd(s, b - (s - a));
+}
+
+Dd two_sum(double a, double b) {
+    double s = a + b;
+    double bb = s - a;
+    return Dd(s, (a - (s - bb)) + (b - bb));
+}
+
+Dd two_prod(double a, double b) {
+    const double splitter = 134217729.;
+    double p = a * b;
+    double ta = splitter * a;
+    double ah = ta - (ta - a);
+    double al = a - ah;
+    double tb = splitter * b;
+    double bh = tb - (tb - b);
+    double bl = b - bh;
+    return Dd(p, ((ah * bh - p) + ah * bl + al * bh) + al * bl);
+}
+
+Dd operator+(const Dd & a, const Dd & b) {
+    Dd s = two_sum(a.hi, b.hi);
+    Dd t = two_sum(a.lo, b.lo);
+    s = quick_two_sum(s.hi, s.lo + t.hi);
+    return quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+Dd operator-(const Dd & a, const Dd & b) {
+    return a + Dd(-b.hi, -b.lo);
+}
+
+Dd operator*(const Dd & a, const Dd & b) {
+    Dd p = two_prod(a.hi, b.hi);
+    return quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+float lead(float v) { return v; }
+double lead(double v) { return v; }
+double lead(const Dd & v) { return v.hi; }
+
+/* Seeds as the kernels see them, only double-double keeps the low part */
+float seed(float, double hi, double) { return (float)hi; }
+double seed(double, double hi, double) { return hi; }
+Dd seed(Dd, double hi, double lo) { return Dd(hi, lo); }
+
+/* Escape time and positions of one sample, iterated in N with reals T */
+template <typename N, typename T>
+uint64_t scalar_orbit(const OrbitKernelParams & p, double c_re, double c_im,
+                      double c_re_lo, double c_im_lo, std::vector<uint64_t> & orbit) {
+    N cr = seed(N(), c_re, c_re_lo), ci = seed(N(), c_im, c_im_lo);
+    N zr = cr, zi = ci;
+    N center_re = seed(N(), p.center_re, p.center_re_lo);
+    N center_im = seed(N(), p.center_im, p.center_im_lo);
+    uint64_t it = 0;
+
+    orbit.clear();
+    for (; it < p.max_iterations; ++it) {
+        N zr2 = zr * zr;
+        N zi2 = zi * zi;
+        if (!(lead(zr2 + zi2) < (T)p.escape_radius_sqr))
+            break;
+
+        T fx = (T)lead(zr - center_re) * (T)p.scale_x + (T)p.offset_x;
+        T fy = (T)lead(zi - center_im) * (T)p.scale_y + (T)p.offset_y;
+        if (fx >= 0 && fx < (T)p.x_size && fy >= 0 && fy < (T)p.y_size) {
+            uint64_t y = (uint64_t)fy;
+            if (p.fold_y && y >= p.y_size / 2)
+                y = p.y_size - 1 - y;
+            orbit.push_back(y * p.x_size + (uint64_t)fx);
+        } else {
+            orbit.push_back(orbit_outside);
+        }
+
+        N re = zr2 - zi2 + cr;
+        zi = (zr + zr) * zi + ci;
+        zr = re;
+    }
+    return it;
+}
+
+std::vector<uint64_t> reference(const OrbitKernel & kernel, const OrbitKernelParams & p,
+                                double c_re, double c_im,
+                                double c_re_lo = 0., double c_im_lo = 0.) {
+    std::vector<uint64_t> orbit;
+    if (OrbitPrecision::FLOAT == kernel.precision)
+        scalar_orbit<float, float>(p, c_re, c_im, c_re_lo, c_im_lo, orbit);
+    else if (OrbitPrecision::DOUBLE == kernel.precision)
+        scalar_orbit<double, double>(p, c_re, c_im, c_re_lo, c_im_lo, orbit);
+    else
+        scalar_orbit<Dd, double>(p, c_re, c_im, c_re_lo, c_im_lo, orbit);
+    return orbit;
+}
+
+/* Seeds around the set, a few of them on the real axis inside of it */
+void make_seeds(std::size_t n, std::vector<double> & c_re, std::vector<double> & c_im) {
+    uint64_t x = 88172645463325252ull;
+    c_re.resize(n);
+    c_im.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        c_re[i] = -2.2 + 3. * (x >> 11) * (1. / 9007199254740992.);
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        c_im[i] = -1.5 + 3. * (x >> 11) * (1. / 9007199254740992.);
+    }
+    c_re[0] = -.75;
+    c_im[0] = .1;
+    c_re[1] = -.1;
+    c_im[1] = 0.;
+
+    /* Chaotic bounded orbits, they show the low parts of the seeds */
+    c_re[2] = -1.8;
+    c_im[2] = 0.;
+    c_re[3] = -1.95;
+    c_im[3] = 0.;
+}
+
+void check_whole_run(const OrbitKernel & kernel, const OrbitKernelParams & p,
+                     const std::vector<double> & c_re, const std::vector<double> & c_im,
+                     const std::vector<double> & c_re_lo = std::vector<double>(),
+                     const std::vector<double> & c_im_lo = std::vector<double>()) {
+    const std::size_t stride = p.max_iterations;
+    const bool lo = !c_re_lo.empty();
+    std::vector<uint64_t> escape(kernel.lanes), orbit(kernel.lanes * stride);
+
+    kernel.run(p, &c_re[0], &c_im[0], lo ? &c_re_lo[0] : nullptr, lo ? &c_im_lo[0] : nullptr,
+               &escape[0], &orbit[0], stride, nullptr);
+
+    for (std::size_t k = 0; k < kernel.lanes; ++k) {
+        std::vector<uint64_t> expected = reference(kernel, p, c_re[k], c_im[k],
+                                                   lo ? c_re_lo[k] : 0., lo ? c_im_lo[k] : 0.);
+        CHECK(escape[k] == expected.size());
+        std::size_t n = std::min<std::size_t>(escape[k], expected.size());
+        CHECK(std::equal(expected.begin(), expected.begin() + n, orbit.begin() + k * stride));
+    }
+}
+
+void check_chunked_run(const OrbitKernel & kernel, const OrbitKernelParams & p,
+                       const std::vector<double> & c_re, const std::vector<double> & c_im) {
+    const uint64_t chunk = 37;
+    const std::size_t lanes = kernel.lanes;
+    std::vector<uint64_t> escape(lanes), orbit(lanes * chunk);
+    std::vector<double> z_re(c_re.begin(), c_re.begin() + lanes);
+    std::vector<double> z_im(c_im.begin(), c_im.begin() + lanes);
+    std::vector<double> z_re_lo(lanes), z_im_lo(lanes);
+    OrbitState state = { &z_re[0], &z_im[0], &z_re_lo[0], &z_im_lo[0] };
+    std::vector<std::vector<uint64_t> > expected(lanes), seen(lanes);
+    std::vector<bool> done(lanes);
+
+    for (std::size_t k = 0; k < lanes; ++k)
+        expected[k] = reference(kernel, p, c_re[k], c_im[k]);
+
+    OrbitKernelParams q = p;
+    for (uint64_t start = 0; start < p.max_iterations; start += chunk) {
+        q.max_iterations = std::min(chunk, p.max_iterations - start);
+        kernel.run(q, &c_re[0], &c_im[0], nullptr, nullptr, &escape[0], &orbit[0], chunk, &state);
+        for (std::size_t k = 0; k < lanes; ++k) {
+            if (done[k])
+                continue;
+            seen[k].insert(seen[k].end(), orbit.begin() + k * chunk,
+                           orbit.begin() + k * chunk + escape[k]);
+            done[k] = escape[k] < q.max_iterations;
+        }
+    }
+
+    for (std::size_t k = 0; k < lanes; ++k)
+        CHECK(seen[k] == expected[k]);
+}
+
+} // namespace
+
+int main() {
+    OrbitKernelParams p = OrbitKernelParams();
+    p.escape_radius_sqr = 4.;
+    p.max_iterations = 300;
+    p.x_size = 96;
+    p.y_size = 64;
+    p.center_re = -.5;
+    p.scale_x = p.x_size / 3.;
+    p.offset_x = p.x_size / 2.;
+    p.scale_y = p.y_size / 3.;
+    p.offset_y = p.y_size / 2.;
+
+    std::vector<double> c_re, c_im;
+    std::size_t tested = 0;
+    for (const OrbitKernel & kernel : orbit_kernels()) {
+        if (!kernel.supported)
+            continue;
+        std::cout << kernel.name << " " << orbit_precision_name(kernel.precision)
+                  << " (" << kernel.lanes << " lanes)" << std::endl;
+        make_seeds(kernel.lanes, c_re, c_im);
+        check_whole_run(kernel, p, c_re, c_im);
+        check_chunked_run(kernel, p, c_re, c_im);
+
+        OrbitKernelParams folded = p;
+        folded.fold_y = true;
+        check_whole_run(kernel, folded, c_re, c_im);
+
+        /* Low parts far below the last bit of the seeds */
+        std::vector<double> c_re_lo(kernel.lanes), c_im_lo(kernel.lanes);
+        for (std::size_t k = 0; k < kernel.lanes; ++k) {
+            c_re_lo[k] = std::ldexp(c_re[k], -60);
+            c_im_lo[k] = std::ldexp(c_im[k], -61);
+        }
+        check_whole_run(kernel, p, c_re, c_im, c_re_lo, c_im_lo);
+
+        /* A deep zoom whose centre needs its low part */
+        OrbitKernelParams zoomed = p;
+        zoomed.center_re = -1.8;
+        zoomed.center_re_lo = std::ldexp(-1.8, -58);
+        zoomed.scale_x = std::ldexp(1., 62);
+        check_whole_run(kernel, zoomed, c_re, c_im, c_re_lo, c_im_lo);
+        ++tested;
+    }
+    CHECK(tested > 0);
+
+    return check_result();
+}
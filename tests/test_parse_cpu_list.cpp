@@ -0,0 +1,54 @@
+/*
+ * parse_cpu_list() reads the CPU and node lists of sysfs. It has to expand
+ * ranges and reject anything that is not such a list.
+ */
+
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "Numa.h"
+
+namespace {
+
+bool parses_to(const std::string & list, const std::vector<int> & expected) {
+    std::vector<int> cpus;
+    return parse_cpu_list(list, cpus) && cpus == expected;
+}
+
+bool rejects(const std::string & list) {
+    std::vector<int> cpus;
+    return !parse_cpu_list(list, cpus);
+}
+
+} // namespace
+
+int main() {
+    CHECK(parses_to("0", { 0 }));
+    CHECK(parses_to("0-3", { 0, 1, 2, 3 }));
+    CHECK(parses_to("0-3,8,10-11", { 0, 1, 2, 3, 8, 10, 11 }));
+    CHECK(parses_to("5-5", { 5 }));
+
+    /* sysfs ends the line with a newline, an empty list is an empty node */
+    CHECK(parses_to("0-1,4\n", { 0, 1, 4 }));
+    CHECK(parses_to(" 2 , 3 - 4 ", { 2, 3, 4 }));
+    CHECK(parses_to("", { }));
+    CHECK(parses_to("\n", { }));
+    CHECK(parses_to("1,,2", { 1, 2 }));
+
+    /* Appends to what the vector held */
+    std::vector<int> cpus = { 7 };
+    CHECK(parse_cpu_list("1-2", cpus));
+    CHECK(cpus == std::vector<int>({ 7, 1, 2 }));
+
+    CHECK(rejects("a"));
+    CHECK(rejects("3-"));
+    CHECK(rejects("3-1"));
+    CHECK(rejects("1:3"));
+    CHECK(rejects("-1"));
+    CHECK(rejects("1-2-3"));
+    CHECK(rejects("0-3x"));
+    CHECK(rejects("0,1;2"));
+
+    return check_result();
+}
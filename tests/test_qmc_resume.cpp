@@ -0,0 +1,78 @@
+/*
+ * A low discrepancy render stopped early and resumed from its checkpoint
+ * has to trace exactly the samples of an uninterrupted render, so both
+ * leave the same histogram. The same goes for a render extended to more
+ * samples after it finished.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "Check.h"
+#include "Fixture.h"
+
+namespace {
+
+const uint64_t samples = 200000;
+
+Buddha::Params params(Buddha::Sampler sampler, const std::string & name) {
+    Buddha::Params p = test_params(name);
+    p.num_threads = 3;
+    p.sampler = sampler;
+    p.samples = samples;
+    p.random_seed = 7;
+    return p;
+}
+
+void check_resume(Buddha::Sampler sampler, const std::string & name) {
+    const std::string whole = name + "_whole";
+    const std::string part = name + "_part";
+    remove_outputs(whole);
+    remove_outputs(part);
+
+    Buddha(params(sampler, whole)).run();
+    std::vector<uint64_t> expected = load_counts(whole + ".hist");
+
+    /* Stopped after a third of the samples, then resumed to the end */
+    Buddha::Params p = params(sampler, part);
+    p.checkpoint = part + ".ckpt";
+    p.sample_limit = samples / 3;
+    Buddha(p).run();
+    uint64_t done = 0;
+    load_counts(p.checkpoint, &done);
+    CHECK(done >= samples / 3 && done < samples);
+
+    p.sample_limit = 0;
+    Buddha(p).run();
+    CHECK(load_counts(p.checkpoint, &done) == expected);
+    CHECK(done == samples);
+    CHECK(load_counts(part + ".hist") == expected);
+    remove_outputs(part);
+
+    /* A finished render of half the samples, extended to all of them */
+    p = params(sampler, part);
+    p.checkpoint = part + ".ckpt";
+    p.samples = samples / 2;
+    Buddha(p).run();
+    p.samples = samples;
+    Buddha(p).run();
+    CHECK(load_counts(p.checkpoint, &done) == expected);
+    CHECK(done == samples);
+
+    remove_outputs(whole);
+    remove_outputs(part);
+}
+
+} // namespace
+
+int main() {
+    std::cout << "sobol" << std::endl;
+    check_resume(Buddha::Sampler::SOBOL, "test_qmc_resume_sobol");
+    std::cout << "halton" << std::endl;
+    check_resume(Buddha::Sampler::HALTON, "test_qmc_resume_halton");
+
+    return check_result();
+}
@@ -0,0 +1,47 @@
+/*
+ * A seed cache recorded by a symmetric render holds the upper half of the
+ * plane. Mirrored into a full render of the same grid it has to give the
+ * histogram of a full render that scans the grid.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "Check.h"
+#include "Fixture.h"
+
+int main() {
+    const std::string full = "test_seed_cache_full";
+    const std::string replay = "test_seed_cache_replay";
+    const std::string cache = "test_seed_cache.seeds";
+    std::remove(cache.c_str());
+
+    Buddha::Params p = test_params(full);
+    p.subpixel_resolution = 2;
+    Buddha(p).run();
+
+    /* Recorded while sampling the upper half, then replayed mirrored */
+    Buddha::Params q = test_params("test_seed_cache_record");
+    q.subpixel_resolution = 2;
+    q.symmetric = true;
+    q.seed_cache = cache;
+    Buddha(q).run();
+    remove_outputs(q.name);
+
+    q.name = replay;
+    q.symmetric = false;
+    Buddha(q).run();
+
+    std::vector<uint64_t> expected = load_counts(full + ".hist");
+    CHECK(!expected.empty());
+    CHECK(load_counts(replay + ".hist") == expected);
+
+    remove_outputs(full);
+    remove_outputs(replay);
+    std::remove(cache.c_str());
+
+    return check_result();
+}
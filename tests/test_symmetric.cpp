@@ -0,0 +1,77 @@
+/*
+ * Symmetric sampling traces the seeds above the real axis only and folds
+ * their orbits onto the top half of the image, the half render() shows.
+ * That half has to match a full render exactly. Sizes with a row of seeds
+ * or pixels on the axis cannot be folded and have to fall back to a full
+ * render.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Buddha.h"
+#include "Check.h"
+#include "Fixture.h"
+#include "HistogramFile.h"
+
+namespace {
+
+bool symmetric_header(const std::string & filename) {
+    MappedHistogram h(filename);
+    return h.header().symmetric;
+}
+
+void check_size(uint64_t width, uint64_t height, uint64_t subpixels, bool folds) {
+    std::cout << width << "x" << height << ", " << subpixels << " subpixels" << std::endl;
+    const std::string full = "test_symmetric_full";
+    const std::string half = "test_symmetric_half";
+
+    Buddha::Params p = test_params(full);
+    p.width = width;
+    p.height = height;
+    p.subpixel_resolution = subpixels;
+    Buddha(p).run();
+
+    p.name = half;
+    p.symmetric = true;
+    Buddha(p).run();
+
+    std::vector<uint64_t> expected = load_counts(full + ".hist");
+    std::vector<uint64_t> counts = load_counts(half + ".hist");
+    CHECK(symmetric_header(half + ".hist") == folds);
+    CHECK(expected.size() == counts.size());
+
+    /* Everything render() shows, the middle row of an odd height included */
+    const uint64_t shown = (height + 1) / 2 * width;
+    const uint64_t compared = folds ? shown : expected.size();
+    CHECK(counts.size() >= compared);
+    CHECK(std::vector<uint64_t>(expected.begin(), expected.begin() + compared)
+          == std::vector<uint64_t>(counts.begin(), counts.begin() + compared));
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < shown; ++i)
+        total += expected[i];
+    CHECK(total > 0);
+
+    remove_outputs(full);
+    remove_outputs(half);
+}
+
+} // namespace
+
+int main() {
+    check_size(96, 64, 1, true);
+    check_size(96, 64, 2, true);
+    check_size(96, 64, 3, true);
+    check_size(97, 64, 2, true);
+
+    /* A row of pixels or of seeds on the axis */
+    check_size(101, 101, 1, false);
+    check_size(96, 63, 2, false);
+    check_size(101, 64, 1, false);
+    check_size(101, 64, 3, false);
+
+    return check_result();
+}